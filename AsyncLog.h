@@ -0,0 +1,267 @@
+#ifndef ASYNC_LOG_H
+#define ASYNC_LOG_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Log levels, most to least important. Routing-table dumps and DV contents
+// are LOG_DEBUG so a busy router can keep its event log without them.
+enum LogLevel {
+    LOG_NONE = 0,
+    LOG_ERROR = 1,
+    LOG_INFO = 2,
+    LOG_DEBUG = 3
+};
+
+// Asynchronous log file with an ostream-like front end.
+//
+// Every line is LOG_INFO unless it starts with at(); lines above the configured
+// level are skipped before any formatting happens.
+//
+// Each thread that logs gets its own producer: it formats a line into a
+// reusable staging buffer and, on endl/flush, copies it into that thread's
+// lock-free single-producer ring. A background thread drains the rings with
+// one writev per ring per batch, so logging threads never block on the file.
+// When a ring is full the line is dropped and counted rather than stalling.
+class AsyncLog {
+    const static size_t MAX_PRODUCERS = 64;
+public:
+    AsyncLog(size_t capacity = 1 << 22)
+    : capacity(round_up(capacity)), nproducers(0), dropped_lines(0), fd(-1), running(false),
+    level(LOG_DEBUG), log_id(next_log_id()++)
+    {
+        for (size_t i = 0; i < MAX_PRODUCERS; i++) producers[i] = NULL;
+    }
+
+    ~AsyncLog()
+    {
+        close();
+        for (size_t i = 0; i < MAX_PRODUCERS; i++) delete producers[i].load();
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) return false;
+        running = true;
+        writer = std::thread(&AsyncLog::writer_loop, this);
+        return true;
+    }
+
+    // stop the writer after it has drained everything logged so far;
+    // threads still logging must be stopped first
+    void close()
+    {
+        if (fd < 0) return;
+        local().commit(*this);
+        running = false;
+        writer.join();
+        ::close(fd);
+        fd = -1;
+    }
+
+    void set_level(LogLevel new_level) { level = new_level; }
+    bool enabled(LogLevel at) const { return at <= level; }
+
+    // set the level of the line about to be written
+    AsyncLog& at(LogLevel at_level)
+    {
+        local().line_level = at_level;
+        return *this;
+    }
+
+    uint64_t dropped() const { return dropped_lines.load(std::memory_order_relaxed); }
+
+    // asctime-style wall clock, reformatted at most once a second per thread
+    const char* timestamp()
+    {
+        Producer& p = local();
+        time_t now = time(NULL);
+        if (now != p.cached_sec)
+        {
+            struct tm timeinfo;
+            localtime_r(&now, &timeinfo);
+            asctime_r(&timeinfo, p.cached_time);
+            p.cached_time[strlen(p.cached_time) - 1] = '\0';
+            p.cached_sec = now;
+        }
+        return p.cached_time;
+    }
+
+    AsyncLog& operator<<(const std::string& s) { Producer& p = local(); if (!muted(p)) p.line.append(s); return *this; }
+    AsyncLog& operator<<(const char* s) { Producer& p = local(); if (!muted(p)) p.line.append(s); return *this; }
+    AsyncLog& operator<<(char c) { Producer& p = local(); if (!muted(p)) p.line.push_back(c); return *this; }
+    AsyncLog& operator<<(int v) { return format("%d", v); }
+    AsyncLog& operator<<(unsigned v) { return format("%u", v); }
+    AsyncLog& operator<<(long v) { return format("%ld", v); }
+    AsyncLog& operator<<(unsigned long v) { return format("%lu", v); }
+    AsyncLog& operator<<(long long v) { return format("%lld", v); }
+    AsyncLog& operator<<(unsigned long long v) { return format("%llu", v); }
+    AsyncLog& operator<<(double v) { return format("%g", v); }
+
+    // append raw bytes, e.g. a field still sitting in a receive buffer
+    AsyncLog& write(const char* data, size_t len)
+    {
+        Producer& p = local();
+        if (!muted(p)) p.line.append(data, len);
+        return *this;
+    }
+
+    // std::endl ends the line; std::flush hands what is staged to the writer
+    AsyncLog& operator<<(std::ostream& (*manip)(std::ostream&))
+    {
+        Producer& p = local();
+        bool end_of_line = manip == static_cast<std::ostream& (*)(std::ostream&)>(std::endl);
+        if (!muted(p))
+        {
+            if (end_of_line) p.line.push_back('\n');
+            p.commit(*this);
+        }
+        if (end_of_line) p.line_level = LOG_INFO;
+        return *this;
+    }
+
+private:
+    // one logging thread's staging buffer and ring
+    struct Producer {
+        Producer(size_t capacity)
+        : ring(capacity), mask(capacity - 1), head(0), tail(0), line_level(LOG_INFO), cached_sec(0)
+        {
+            cached_time[0] = '\0';
+        }
+
+        // publish the staged bytes to the ring, or drop them if it is full
+        void commit(AsyncLog& log)
+        {
+            if (line.empty() || log.fd < 0) return;
+            size_t h = head.load(std::memory_order_relaxed);
+            size_t t = tail.load(std::memory_order_acquire);
+            if (line.size() > ring.size() - (h - t))
+            {
+                log.dropped_lines.fetch_add(1, std::memory_order_relaxed);
+                line.clear();
+                return;
+            }
+            size_t at = h & mask;
+            size_t first = std::min(line.size(), ring.size() - at);
+            memcpy(&ring[at], line.data(), first);
+            memcpy(&ring[0], line.data() + first, line.size() - first);
+            head.store(h + line.size(), std::memory_order_release);
+            line.clear();
+        }
+
+        // write out everything published so far (two pieces if it wraps);
+        // returns false if there was nothing to write
+        bool drain(int fd)
+        {
+            size_t t = tail.load(std::memory_order_relaxed);
+            size_t h = head.load(std::memory_order_acquire);
+            if (h == t) return false;
+            size_t at = t & mask;
+            size_t len = h - t;
+            struct iovec iov[2];
+            iov[0].iov_base = &ring[at];
+            iov[0].iov_len = std::min(len, ring.size() - at);
+            iov[1].iov_base = &ring[0];
+            iov[1].iov_len = len - iov[0].iov_len;
+            ssize_t n = writev(fd, iov, iov[1].iov_len ? 2 : 1);
+            if (n <= 0) n = len; // nothing sensible to do with a failing log file
+            tail.store(t + n, std::memory_order_release);
+            return true;
+        }
+
+        std::vector<char> ring;
+        size_t mask;
+        std::atomic<size_t> head; // bytes published by the producer
+        std::atomic<size_t> tail; // bytes written out by the writer
+        LogLevel line_level; // level of the line being formatted
+        std::string line; // the line being formatted
+        time_t cached_sec;
+        char cached_time[32];
+    };
+
+    static std::atomic<uint64_t>& next_log_id()
+    {
+        static std::atomic<uint64_t> id(1);
+        return id;
+    }
+
+    static size_t round_up(size_t n)
+    {
+        size_t p = 1;
+        while (p < n) p <<= 1;
+        return p;
+    }
+
+    // the calling thread's producer, registered on first use
+    Producer& local()
+    {
+        thread_local Producer* producer = NULL;
+        thread_local uint64_t owner = 0;
+        if (owner != log_id)
+        {
+            size_t slot = nproducers.fetch_add(1);
+            if (slot >= MAX_PRODUCERS) abort();
+            producer = new Producer(capacity);
+            producers[slot].store(producer, std::memory_order_release);
+            owner = log_id;
+        }
+        return *producer;
+    }
+
+    bool muted(const Producer& p) const { return p.line_level > level; }
+
+    template <class T>
+    AsyncLog& format(const char* fmt, T v)
+    {
+        Producer& p = local();
+        if (muted(p)) return *this;
+        char buf[32];
+        int n = snprintf(buf, sizeof(buf), fmt, v);
+        p.line.append(buf, n);
+        return *this;
+    }
+
+    void writer_loop()
+    {
+        while (true)
+        {
+            bool stopping = !running.load(std::memory_order_acquire);
+            bool wrote = false;
+            size_t n = std::min(nproducers.load(std::memory_order_acquire), MAX_PRODUCERS);
+            for (size_t i = 0; i < n; i++)
+            {
+                Producer* p = producers[i].load(std::memory_order_acquire);
+                if (p && p->drain(fd)) wrote = true;
+            }
+            if (wrote) continue;
+            if (stopping) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+
+    size_t capacity; // bytes per producer ring
+    std::atomic<Producer*> producers[MAX_PRODUCERS];
+    std::atomic<size_t> nproducers;
+    std::atomic<uint64_t> dropped_lines;
+    int fd;
+    std::atomic<bool> running;
+    std::thread writer;
+    LogLevel level;
+    uint64_t log_id; // tells this log's thread-local producers from an earlier log's
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef BATCH_UDP_H
+#define BATCH_UDP_H
+
+#include <boost/asio.hpp>
+#include <boost/bind.hpp>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+// Batched UDP I/O for a bound socket. Instead of one completion per
+// datagram, it waits for the socket to become readable and then pulls up to
+// `batch` datagrams per recvmmsg. Outgoing datagrams are queued and the whole
+// queue goes out in one sendmmsg at the end of the current event-loop turn.
+// Queued datagrams are copied, so the caller's buffer may be reused at once.
+//
+// Both halves run on the io_service the socket belongs to; the object must
+// only be used from the thread(s) running it. Without recvmmsg/sendmmsg
+// (non-Linux) it falls back to one recvfrom/sendto per datagram.
+class BatchUdp {
+    const static size_t MAX_ROUNDS = 8; // recv batches per readiness before yielding
+public:
+    typedef boost::asio::ip::udp udp;
+    typedef std::function<void(const char* data, size_t len, const udp::endpoint& from)> Handler;
+
+    BatchUdp(udp::socket& sock, size_t batch, size_t max_len)
+    : sock(sock), batch(batch), max_len(max_len), rx_data(batch * max_len), rx_addr(batch),
+    rx_iov(batch), out_head(0), flush_pending(false), dropped(0)
+    {
+        sock.non_blocking(true);
+#ifdef __linux__
+        rx_hdrs.resize(batch);
+#endif
+        for (size_t i = 0; i < batch; i++)
+        {
+            rx_iov[i].iov_base = &rx_data[i * max_len];
+            rx_iov[i].iov_len = max_len;
+        }
+    }
+
+    // deliver every datagram received from now on to handler
+    void start(Handler new_handler)
+    {
+        handler = new_handler;
+        wait_readable();
+    }
+
+    void send(const char* data, size_t len, const udp::endpoint& to)
+    {
+        OutMsg msg;
+        msg.offset = out_data.size();
+        msg.len = len;
+        memset(&msg.to, 0, sizeof(msg.to));
+        msg.to.sin_family = AF_INET;
+        msg.to.sin_port = htons(to.port());
+        msg.to.sin_addr.s_addr = htonl(to.address().to_v4().to_ulong());
+        out_data.insert(out_data.end(), data, data + len);
+        out.push_back(msg);
+
+        if (!flush_pending)
+        {
+            flush_pending = true;
+            boost::asio::post(sock.get_executor(), boost::bind(&BatchUdp::flush, this));
+        }
+    }
+
+    // datagrams the kernel refused; readable from any thread
+    uint64_t send_errors() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct OutMsg {
+        size_t offset; // into out_data
+        size_t len;
+        sockaddr_in to;
+    };
+
+    void wait_readable()
+    {
+        sock.async_wait(udp::socket::wait_read,
+                        boost::bind(&BatchUdp::handle_readable, this, boost::asio::placeholders::error));
+    }
+
+    void handle_readable(const boost::system::error_code& error)
+    {
+        if (error == boost::asio::error::operation_aborted) return;
+        for (size_t round = 0; round < MAX_ROUNDS; round++)
+        {
+            int n = recv_batch();
+            for (int i = 0; i < n; i++)
+            {
+                udp::endpoint from(boost::asio::ip::address_v4(ntohl(rx_addr[i].sin_addr.s_addr)),
+                                   ntohs(rx_addr[i].sin_port));
+                handler(&rx_data[i * max_len], rx_len(i), from);
+            }
+            if (n < (int) batch) break;
+        }
+        wait_readable();
+    }
+
+    // send everything queued; on a full socket buffer wait until it drains
+    void flush()
+    {
+        while (out_head < out.size())
+        {
+            int n = send_batch();
+            if (n < 0)
+            {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                {
+                    sock.async_wait(udp::socket::wait_write, boost::bind(&BatchUdp::flush, this));
+                    return;
+                }
+                n = 1; // undeliverable datagram; drop it and go on with the rest
+                dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            out_head += n;
+        }
+        out.clear();
+        out_data.clear();
+        out_head = 0;
+        flush_pending = false;
+    }
+
+#ifdef __linux__
+    int recv_batch()
+    {
+        for (size_t i = 0; i < batch; i++)
+        {
+            memset(&rx_hdrs[i].msg_hdr, 0, sizeof(rx_hdrs[i].msg_hdr));
+            rx_hdrs[i].msg_hdr.msg_name = &rx_addr[i];
+            rx_hdrs[i].msg_hdr.msg_namelen = sizeof(rx_addr[i]);
+            rx_hdrs[i].msg_hdr.msg_iov = &rx_iov[i];
+            rx_hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        return recvmmsg(sock.native_handle(), rx_hdrs.data(), batch, MSG_DONTWAIT, NULL);
+    }
+
+    size_t rx_len(int i) const { return rx_hdrs[i].msg_len; }
+
+    int send_batch()
+    {
+        size_t count = std::min(out.size() - out_head, (size_t) UIO_MAXIOV);
+        tx_hdrs.resize(count);
+        tx_iov.resize(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            OutMsg& msg = out[out_head + i];
+            tx_iov[i].iov_base = &out_data[msg.offset];
+            tx_iov[i].iov_len = msg.len;
+            memset(&tx_hdrs[i].msg_hdr, 0, sizeof(tx_hdrs[i].msg_hdr));
+            tx_hdrs[i].msg_hdr.msg_name = &msg.to;
+            tx_hdrs[i].msg_hdr.msg_namelen = sizeof(msg.to);
+            tx_hdrs[i].msg_hdr.msg_iov = &tx_iov[i];
+            tx_hdrs[i].msg_hdr.msg_iovlen = 1;
+        }
+        return sendmmsg(sock.native_handle(), tx_hdrs.data(), count, MSG_DONTWAIT);
+    }
+#else
+    int recv_batch()
+    {
+        size_t n = 0;
+        for (; n < batch; n++)
+        {
+            socklen_t addr_len = sizeof(rx_addr[n]);
+            ssize_t len = recvfrom(sock.native_handle(), rx_iov[n].iov_base, max_len, MSG_DONTWAIT,
+                                   (sockaddr*) &rx_addr[n], &addr_len);
+            if (len < 0) break;
+            rx_lens.resize(batch);
+            rx_lens[n] = len;
+        }
+        return (int) n;
+    }
+
+    size_t rx_len(int i) const { return rx_lens[i]; }
+
+    int send_batch()
+    {
+        OutMsg& msg = out[out_head];
+        ssize_t len = sendto(sock.native_handle(), &out_data[msg.offset], msg.len, MSG_DONTWAIT,
+                             (const sockaddr*) &msg.to, sizeof(msg.to));
+        return len < 0 ? -1 : 1;
+    }
+
+    std::vector<size_t> rx_lens;
+#endif
+
+    udp::socket& sock;
+    size_t batch; // datagrams per recvmmsg
+    size_t max_len; // largest datagram received in full
+    Handler handler;
+    std::vector<char> rx_data; // batch receive buffers of max_len bytes each
+    std::vector<sockaddr_in> rx_addr;
+    std::vector<iovec> rx_iov;
+    std::vector<char> out_data; // queued datagrams back to back
+    std::vector<OutMsg> out;
+    size_t out_head; // first queued datagram not yet sent
+    bool flush_pending; // a flush is posted or waiting for the socket to drain
+    std::atomic<uint64_t> dropped; // only the io_service thread writes it
+#ifdef __linux__
+    std::vector<mmsghdr> rx_hdrs, tx_hdrs;
+    std::vector<iovec> tx_iov;
+#endif
+};
+
+#endif
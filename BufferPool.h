@@ -0,0 +1,162 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Pool of fixed-size send slabs. A SendBuffer is a reference-counted handle
+// to one slab: bind it into an async send's completion handler and the slab
+// stays alive until the send completes, then goes back to the pool when the
+// last handle is dropped. Copies share the slab, so a broadcast can hand the
+// same bytes to every neighbor.
+//
+// Slabs may be released from any thread. Handles may outlive the pool (e.g.
+// handlers still queued on an io_service at exit); their slabs are then
+// freed instead of recycled.
+class BufferPool {
+    struct Shared;
+
+    struct Slab {
+        Slab(const std::shared_ptr<Shared>& owner, size_t capacity)
+        : owner(owner), refs(0), len(0), bytes(capacity) {}
+
+        std::shared_ptr<Shared> owner;
+        std::atomic<int> refs;
+        size_t len; // bytes in use
+        std::vector<char> bytes;
+    };
+
+    // the free list, kept alive by outstanding slabs
+    struct Shared {
+        Shared(size_t slab_size, size_t max_free) : slab_size(slab_size), max_free(max_free), closed(false) {}
+
+        void release(Slab* slab)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!closed && slab->bytes.size() == slab_size && free.size() < max_free)
+                {
+                    free.push_back(slab);
+                    return;
+                }
+            }
+            delete slab; // oversized, surplus, or the pool is gone
+        }
+
+        size_t slab_size;
+        size_t max_free; // slabs kept for reuse; the rest are freed
+        bool closed;
+        std::mutex mutex;
+        std::vector<Slab*> free;
+    };
+
+public:
+    class SendBuffer {
+    public:
+        SendBuffer() : slab(NULL) {}
+        SendBuffer(const SendBuffer& other) : slab(other.slab) { if (slab) slab->refs.fetch_add(1, std::memory_order_relaxed); }
+        SendBuffer(SendBuffer&& other) : slab(other.slab) { other.slab = NULL; }
+        ~SendBuffer() { release(); }
+
+        SendBuffer& operator=(const SendBuffer& other)
+        {
+            if (other.slab) other.slab->refs.fetch_add(1, std::memory_order_relaxed);
+            release();
+            slab = other.slab;
+            return *this;
+        }
+
+        SendBuffer& operator=(SendBuffer&& other)
+        {
+            if (this != &other)
+            {
+                release();
+                slab = other.slab;
+                other.slab = NULL;
+            }
+            return *this;
+        }
+
+        char* data() { return &slab->bytes[0]; }
+        const char* data() const { return &slab->bytes[0]; }
+        size_t size() const { return slab ? slab->len : 0; }
+        size_t capacity() const { return slab ? slab->bytes.size() : 0; }
+        bool empty() const { return size() == 0; }
+        bool unique() const { return slab && slab->refs.load(std::memory_order_acquire) == 1; }
+
+        // set the length after writing into data(); must not exceed capacity()
+        void resize(size_t len) { slab->len = len; }
+
+        void assign(const char* bytes, size_t len)
+        {
+            memcpy(data(), bytes, len);
+            slab->len = len;
+        }
+
+        // drop this handle; the slab is recycled once no handle is left
+        void release()
+        {
+            if (slab && slab->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                slab->owner->release(slab);
+            slab = NULL;
+        }
+
+    private:
+        friend class BufferPool;
+        explicit SendBuffer(Slab* slab) : slab(slab) { slab->refs.store(1, std::memory_order_relaxed); }
+
+        Slab* slab;
+    };
+
+    BufferPool(size_t slab_size, size_t max_free = 256)
+    : shared(new Shared(slab_size, max_free)) {}
+
+    ~BufferPool()
+    {
+        std::vector<Slab*> free;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            shared->closed = true;
+            free.swap(shared->free);
+        }
+        for (Slab* slab : free) delete slab;
+    }
+
+    // an empty buffer of at least len bytes; longer than a slab gets a one-off slab
+    SendBuffer get(size_t len = 0)
+    {
+        if (len > shared->slab_size) return SendBuffer(new Slab(shared, len));
+        Slab* slab = NULL;
+        {
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (!shared->free.empty())
+            {
+                slab = shared->free.back();
+                shared->free.pop_back();
+            }
+        }
+        if (!slab) slab = new Slab(shared, shared->slab_size);
+        slab->len = 0;
+        return SendBuffer(slab);
+    }
+
+    // a buffer holding a copy of bytes
+    SendBuffer copy(const char* bytes, size_t len)
+    {
+        SendBuffer buffer = get(len);
+        buffer.assign(bytes, len);
+        return buffer;
+    }
+
+    size_t slab_size() const { return shared->slab_size; }
+
+private:
+    std::shared_ptr<Shared> shared;
+};
+
+typedef BufferPool::SendBuffer SendBuffer;
+
+#endif
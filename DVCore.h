@@ -0,0 +1,2071 @@
+#ifndef DV_CORE_H
+#define DV_CORE_H
+
+#include <boost/algorithm/string.hpp>
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <immintrin.h>
+
+#include "AsyncLog.h"
+#include "BufferPool.h"
+#include "Snapshot.h"
+
+// Routing core of a DV router: the RIB, the neighbors' DVs, route
+// computation and the DV wire formats. It does no I/O of its own; a DVHost
+// delivers its messages and runs its timers, so the same core runs in the
+// router process (DVRouter.cpp) and in the simulator (DVSim.cpp).
+
+#define DV_SEND_SEC 5
+#define FAIL_SEC 10
+#define DV_FULL_SEC 60 // full-table refresh period for neighbors that take deltas
+
+#define INF 100000
+
+
+#define MAX_DV_LENGTH 65536 // largest UDP payload, so a full-table DV fits
+#define MAX_ECMP 8 // most equal-cost next hops kept per destination
+#define SEQREQ_HOPS 64 // how far a sequence number request travels towards the destination
+
+using namespace std;
+
+// Routing options DVCore itself acts on
+struct CoreOptions {
+    CoreOptions() : delta(false), hold_ms(50), hello_ms(0), hello_mult(3), ecmp(1), loop_free(false) {}
+    
+    bool delta; // send incremental DVs to neighbors that accept them
+    int hold_ms; // triggered updates: at most one per window; 0 sends each change at once
+    int hello_ms; // hello interval the host runs on_hello_timer at; 0 sends no hellos
+    int hello_mult; // hellos a neighbor may miss before we are declared down
+    int ecmp; // equal-cost next hops kept per destination, 1 to MAX_ECMP
+    bool loop_free; // only install feasible routes (sequence numbers and feasible distances); every router must enable it
+};
+
+// Interface to neighbor node
+struct Interface {
+    Interface(uint16_t port, string neighbor_id, int cost)
+    : port(port), neighbor_id(neighbor_id), idx(0), row(0), cost(cost), down(false), provisional(false), peer_caps(0),
+    acked_version(0), rx_version(0), hello_detect_ms(0) {}
+    
+    uint16_t port;  // neighbor's port number
+    string neighbor_id; // neighbor's id
+    uint32_t idx; // neighbor's router index
+    size_t row; // neighbor's row in the Adj-RIB-In matrix
+    int cost;   // link cost to neighbor
+    bool down; // failure timer ran out; the link counts as INF until a DV arrives
+    bool provisional; // its Adj-RIB-In row came from a snapshot; routes through it are not advertised until a DV arrives
+    uint8_t peer_caps; // capabilities the neighbor advertised in its last DV
+    uint32_t acked_version; // our DV version the neighbor has acknowledged (0: needs a full DV)
+    uint32_t rx_version; // neighbor's DV version we have applied
+    uint32_t hello_detect_ms; // hello session: declare down after this long without one; 0 uses FAIL_SEC of DVs
+};
+
+#define NO_ID 0xFFFFFFFF // IdTable index meaning "no router"
+
+// Interns router names to dense indices. The hash table is open-addressed so
+// a name can be looked up straight from a slice of a datagram.
+class IdTable {
+public:
+    IdTable() : slots(16, NO_ID) {}
+    
+    uint32_t find(const char* name, size_t len) const
+    {
+        size_t mask = slots.size() - 1;
+        for (size_t i = hash(name, len) & mask; ; i = (i + 1) & mask)
+        {
+            uint32_t idx = slots[i];
+            if (idx == NO_ID) return NO_ID;
+            if (names[idx].size() == len && memcmp(names[idx].data(), name, len) == 0) return idx;
+        }
+    }
+    
+    uint32_t find(const string& name) const
+    {
+        return find(name.data(), name.size());
+    }
+    
+    // index of name, assigning the next free one the first time it is seen
+    uint32_t intern(const char* name, size_t len)
+    {
+        uint32_t idx = find(name, len);
+        if (idx != NO_ID) return idx;
+        
+        if ((names.size() + 1) * 2 > slots.size()) grow();
+        idx = (uint32_t) names.size();
+        names.push_back(string(name, len));
+        insert(idx);
+        return idx;
+    }
+    
+    uint32_t intern(const string& name)
+    {
+        return intern(name.data(), name.size());
+    }
+    
+    const string& name(uint32_t idx) const { return names[idx]; }
+    size_t size() const { return names.size(); }
+    
+    static size_t hash(const char* name, size_t len)
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < len; i++)
+        {
+            h ^= (uint8_t) name[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+    
+private:
+    void insert(uint32_t idx)
+    {
+        size_t mask = slots.size() - 1;
+        size_t i = hash(names[idx].data(), names[idx].size()) & mask;
+        while (slots[i] != NO_ID) i = (i + 1) & mask;
+        slots[i] = idx;
+    }
+    
+    void grow()
+    {
+        slots.assign(slots.size() * 2, NO_ID);
+        for (uint32_t idx = 0; idx < names.size(); idx++) insert(idx);
+    }
+    
+    vector<string> names; // index => name
+    vector<uint32_t> slots; // hash slot => index
+};
+
+// Routing table stored as parallel arrays indexed by router index. Every
+// router is its own next hop-less entry; other entries without a next hop
+// are destinations we have not learned a route to. With ECMP, a destination
+// also has up to max_paths equal-cost next hops, the first being next_hop.
+struct Rib {
+    Rib() : max_paths(1), loop_free(false) {}
+    
+    void resize(size_t n)
+    {
+        distance.resize(n, INF);
+        next_hop.resize(n, NO_ID);
+        dest_port.resize(n, 0);
+        changed_at.resize(n, 0);
+        alt_hop.resize(n, NO_ID);
+        alt_distance.resize(n, INF);
+        if (max_paths > 1)
+        {
+            paths.resize(n * max_paths, NO_ID);
+            path_port.resize(n * max_paths, 0);
+            path_count.resize(n, 0);
+        }
+        if (loop_free)
+        {
+            seqno.resize(n, 0);
+            fd_seqno.resize(n, 0);
+            fd_distance.resize(n, INF);
+        }
+    }
+    
+    size_t size() const { return distance.size(); }
+    
+    size_t bytes() const
+    {
+        return distance.capacity() * sizeof(int32_t) + next_hop.capacity() * sizeof(uint32_t) +
+               dest_port.capacity() * sizeof(uint16_t) + changed_at.capacity() * sizeof(uint32_t) +
+               alt_hop.capacity() * sizeof(uint32_t) + alt_distance.capacity() * sizeof(int32_t) +
+               paths.capacity() * sizeof(uint32_t) + path_port.capacity() * sizeof(uint16_t) +
+               path_count.capacity() * sizeof(uint8_t) + seqno.capacity() * sizeof(uint16_t) +
+               fd_seqno.capacity() * sizeof(uint16_t) + fd_distance.capacity() * sizeof(int32_t);
+    }
+    
+    vector<int32_t> distance; // distance to a node, also our advertised DV
+    vector<uint32_t> next_hop; // neighbor router index
+    vector<uint16_t> dest_port; // next hop port number
+    vector<uint32_t> changed_at; // DV version of the entry's last change
+    vector<uint32_t> alt_hop; // loop-free alternate neighbor, NO_ID if there is none
+    vector<int32_t> alt_distance; // distance through alt_hop
+    size_t max_paths; // equal-cost next hops kept per destination
+    vector<uint32_t> paths; // dest * max_paths + i => i-th equal-cost next hop, if max_paths > 1
+    vector<uint16_t> path_port; // port of each of paths
+    vector<uint8_t> path_count; // dest => equal-cost next hops in paths, 0 if only next_hop is known
+    bool loop_free; // the arrays below are kept
+    vector<uint16_t> seqno; // sequence number of the route, originated by dest; ours at self
+    vector<uint16_t> fd_seqno; // feasible distance: the best (seqno, distance) we have installed
+    vector<int32_t> fd_distance; // INF until a route is installed
+};
+
+// a is a later sequence number than b, allowing for wrap-around
+inline int seqno_cmp(uint16_t a, uint16_t b)
+{
+    return (int16_t) (uint16_t) (a - b);
+}
+
+// Adj-RIB-In: the last DV of every neighbor, one row per neighbor and one
+// column per router index. Rows are padded to a multiple of 8 columns of INF
+// so the recompute kernels can run whole vectors without a scalar tail.
+class DVMatrix {
+public:
+    DVMatrix() : rows(0), cols(0), stride(0) {}
+    
+    void resize(size_t new_rows, size_t new_cols)
+    {
+        size_t new_stride = (new_cols + 7) & ~(size_t) 7;
+        if (new_stride != stride)
+        {
+            vector<int32_t> grown(new_rows * new_stride, INF);
+            for (size_t r = 0; r < min(rows, new_rows); r++)
+                memcpy(&grown[r * new_stride], &cells[r * stride], cols * sizeof(int32_t));
+            cells.swap(grown);
+            stride = new_stride;
+        }
+        else
+        {
+            cells.resize(new_rows * stride, INF);
+        }
+        rows = new_rows;
+        cols = new_cols;
+    }
+    
+    int32_t* row(size_t r) { return &cells[r * stride]; }
+    const int32_t* data() const { return cells.data(); }
+    size_t bytes() const { return cells.capacity() * sizeof(int32_t); }
+    
+    size_t rows; // neighbors
+    size_t cols; // router indices
+    size_t stride; // cells between the starts of two rows
+    
+private:
+    vector<int32_t> cells;
+};
+
+// Min-plus kernels: for every column d, best[d] = min over rows n of
+// min(cost[n] + m[n][d], INF) and arg[d] = the first row reaching it (-1 if none
+// is below INF). Columns are processed in blocks of the matrix stride.
+typedef void (*MinPlusKernel)(const int32_t* m, size_t stride, size_t rows, const int32_t* cost,
+                              int32_t* best, int32_t* arg);
+
+static void minplus_scalar(const int32_t* m, size_t stride, size_t rows, const int32_t* cost,
+                           int32_t* best, int32_t* arg)
+{
+    for (size_t d = 0; d < stride; d++)
+    {
+        best[d] = INF;
+        arg[d] = -1;
+    }
+    for (size_t n = 0; n < rows; n++)
+    {
+        const int32_t* r = m + n * stride;
+        for (size_t d = 0; d < stride; d++)
+        {
+            int32_t v = min(cost[n] + r[d], (int32_t) INF);
+            if (v < best[d])
+            {
+                best[d] = v;
+                arg[d] = (int32_t) n;
+            }
+        }
+    }
+}
+
+__attribute__((target("sse4.1")))
+static void minplus_sse41(const int32_t* m, size_t stride, size_t rows, const int32_t* cost,
+                          int32_t* best, int32_t* arg)
+{
+    const __m128i inf = _mm_set1_epi32(INF);
+    for (size_t d = 0; d < stride; d += 4)
+    {
+        __m128i b = inf;
+        __m128i a = _mm_set1_epi32(-1);
+        for (size_t n = 0; n < rows; n++)
+        {
+            __m128i v = _mm_loadu_si128((const __m128i*) (m + n * stride + d));
+            v = _mm_min_epi32(_mm_add_epi32(v, _mm_set1_epi32(cost[n])), inf);
+            __m128i lt = _mm_cmpgt_epi32(b, v);
+            b = _mm_min_epi32(b, v);
+            a = _mm_blendv_epi8(a, _mm_set1_epi32((int32_t) n), lt);
+        }
+        _mm_storeu_si128((__m128i*) (best + d), b);
+        _mm_storeu_si128((__m128i*) (arg + d), a);
+    }
+}
+
+__attribute__((target("avx2")))
+static void minplus_avx2(const int32_t* m, size_t stride, size_t rows, const int32_t* cost,
+                         int32_t* best, int32_t* arg)
+{
+    const __m256i inf = _mm256_set1_epi32(INF);
+    for (size_t d = 0; d < stride; d += 8)
+    {
+        __m256i b = inf;
+        __m256i a = _mm256_set1_epi32(-1);
+        for (size_t n = 0; n < rows; n++)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i*) (m + n * stride + d));
+            v = _mm256_min_epi32(_mm256_add_epi32(v, _mm256_set1_epi32(cost[n])), inf);
+            __m256i lt = _mm256_cmpgt_epi32(b, v);
+            b = _mm256_min_epi32(b, v);
+            a = _mm256_blendv_epi8(a, _mm256_set1_epi32((int32_t) n), lt);
+        }
+        _mm256_storeu_si256((__m256i*) (best + d), b);
+        _mm256_storeu_si256((__m256i*) (arg + d), a);
+    }
+}
+
+// widest kernel the CPU we are running on supports
+static MinPlusKernel select_minplus_kernel(const char** name)
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        *name = "avx2";
+        return minplus_avx2;
+    }
+    if (__builtin_cpu_supports("sse4.1"))
+    {
+        *name = "sse4.1";
+        return minplus_sse41;
+    }
+    *name = "scalar";
+    return minplus_scalar;
+}
+
+// One (destination, distance) pair of a distance vector
+struct DVEntry {
+    DVEntry(uint32_t dest, int cost, uint16_t seqno = 0) : dest(dest), cost(cost), seqno(seqno) {}
+    
+    uint32_t dest; // router index
+    int cost;
+    uint16_t seqno; // destination's sequence number, if the sender set CAP_SEQNO
+};
+
+// Capability bits a router advertises with its DV so that each neighbor can
+// pick the richest wire format both ends understand.
+#define CAP_BINARY 0x01 // understands the binary DV encoding
+#define CAP_DELTA 0x02 // accepts incremental DVs (binary only)
+#define CAP_SEQNO 0x04 // runs loop-free mode: every entry carries a sequence number
+
+// Binary DV encoding (version 1):
+//   [DVB_MAGIC][DVB_VERSION][type][caps][src len][src id] followed by
+//   DVB_FULL:   [varint version] [varint count] { [dest len][dest id][varint cost] } * count
+//   DVB_DELTA:  [varint base] [varint version] [varint count] { entries as above }
+//   DVB_ACK:    [varint version]
+//   DVB_RESYNC: nothing
+//   DVB_HELLO:  [varint interval ms][detect multiplier]
+//   DVB_SEQREQ: [dest len][dest id][varint seqno][hop count]
+// With CAP_SEQNO in caps, every DV entry is followed by [varint seqno].
+// The magic byte can never start a text message, so both encodings share a port.
+#define DVB_MAGIC 0xD7
+#define DVB_VERSION 1
+#define DVB_HEADER_LEN 5
+
+#define DVB_FULL 1 // complete distance vector
+#define DVB_DELTA 2 // entries changed since the version the neighbor acknowledged
+#define DVB_ACK 3 // receiver has applied everything up to a version
+#define DVB_RESYNC 4 // receiver missed a delta and wants a full DV
+#define DVB_HELLO 5 // liveness probe, sent every interval ms whatever the DV traffic
+#define DVB_SEQREQ 6 // asks dest for a sequence number at least seqno (loop-free mode)
+
+// LEB128 varint helpers; return the number of bytes written / consumed, 0 on overflow
+inline size_t put_varint(char* buf, size_t cap, uint32_t v)
+{
+    size_t n = 0;
+    do
+    {
+        if (n == cap) return 0;
+        uint8_t byte = v & 0x7F;
+        v >>= 7;
+        if (v) byte |= 0x80;
+        buf[n++] = (char) byte;
+    } while (v);
+    return n;
+}
+
+inline size_t get_varint(const char* buf, size_t len, uint32_t& v)
+{
+    v = 0;
+    for (size_t n = 0; n < len && n < 5; n++)
+    {
+        uint8_t byte = (uint8_t) buf[n];
+        v |= (uint32_t) (byte & 0x7F) << (7 * n);
+        if (!(byte & 0x80)) return n + 1;
+    }
+    return 0;
+}
+
+
+// Distance vector message
+struct DVMsg {
+    DVMsg(string src_id = "", uint8_t caps = 0)
+    : src_id(src_id), caps(caps), type(DVB_FULL), base(0), version(0) {}
+    
+    // cost_spans, if given, receives the [begin, end) offset of every entry's cost
+    string toString(const IdTable& ids, vector<pair<size_t,size_t> >* cost_spans = NULL) const
+    {
+        // encode object to string
+        string message = "";
+        message += src_id;
+        message += ":";
+        for (auto& entry : entries)
+        {
+            message += ids.name(entry.dest);
+            message += ",";
+            size_t begin = message.size();
+            message += to_string(entry.cost);
+            if (cost_spans) cost_spans->push_back(make_pair(begin, message.size()));
+            if (caps & CAP_SEQNO)
+                message += "," + to_string(entry.seqno);
+            message += ";";
+        }
+        message += " ";
+        // capability trailer, ignored by routers that only speak text
+        message += "caps=" + to_string(caps);
+        return message;
+    }
+    
+    // decode string to object, scanning the payload once; new destinations are interned
+    static void fromString(const string& str, IdTable& ids, DVMsg& msg)
+    {
+        size_t i = str.find(":");
+        msg = DVMsg(str.substr(0, i));
+        size_t pos = i + 1;
+        while (true)
+        {
+            size_t semi = str.find(";", pos);
+            if (semi == string::npos) break;
+            size_t comma = str.find(",", pos);
+            if (comma == string::npos || comma > semi) break;
+            uint32_t dest = ids.intern(str.data() + pos, comma - pos);
+            msg.entries.push_back(DVEntry(dest, min(atoi(str.c_str() + comma + 1), INF)));
+            size_t seqno = str.find(",", comma + 1);
+            if (seqno < semi)
+                msg.entries.back().seqno = (uint16_t) atoi(str.c_str() + seqno + 1);
+            pos = semi + 1;
+        }
+        size_t c = str.find("caps=", pos);
+        if (c != string::npos)
+            msg.caps = (uint8_t) atoi(str.c_str() + c + 5);
+    }
+    
+    // encode into buf without allocating; returns the encoded length, 0 if it does not fit
+    size_t toBinary(char* buf, size_t cap, const IdTable& ids,
+                    vector<pair<size_t,size_t> >* cost_spans = NULL) const
+    {
+        if (src_id.size() > 255 || cap < DVB_HEADER_LEN + src_id.size()) return 0;
+        size_t n = 0;
+        buf[n++] = (char) DVB_MAGIC;
+        buf[n++] = DVB_VERSION;
+        buf[n++] = (char) type;
+        buf[n++] = (char) caps;
+        buf[n++] = (char) src_id.size();
+        memcpy(buf + n, src_id.data(), src_id.size());
+        n += src_id.size();
+        
+        size_t k;
+        if (type == DVB_DELTA)
+        {
+            if ((k = put_varint(buf + n, cap - n, base)) == 0) return 0;
+            n += k;
+        }
+        if (type == DVB_FULL || type == DVB_DELTA || type == DVB_ACK)
+        {
+            if ((k = put_varint(buf + n, cap - n, version)) == 0) return 0;
+            n += k;
+        }
+        if (type != DVB_FULL && type != DVB_DELTA) return n;
+        
+        if ((k = put_varint(buf + n, cap - n, (uint32_t) entries.size())) == 0) return 0;
+        n += k;
+        
+        for (auto& entry : entries)
+        {
+            const string& dest_id = ids.name(entry.dest);
+            if (dest_id.size() > 255 || cap - n < 1 + dest_id.size()) return 0;
+            buf[n++] = (char) dest_id.size();
+            memcpy(buf + n, dest_id.data(), dest_id.size());
+            n += dest_id.size();
+            k = put_varint(buf + n, cap - n, (uint32_t) entry.cost);
+            if (k == 0) return 0;
+            if (cost_spans) cost_spans->push_back(make_pair(n, n + k));
+            n += k;
+            if (caps & CAP_SEQNO)
+            {
+                if ((k = put_varint(buf + n, cap - n, entry.seqno)) == 0) return 0;
+                n += k;
+            }
+        }
+        return n;
+    }
+    
+    // encode a sequence number request; returns the encoded length, 0 if it does not fit
+    static size_t toSeqnoRequest(char* buf, size_t cap, const string& src_id, uint8_t caps,
+                                 const string& dest_id, uint16_t seqno, uint8_t hops)
+    {
+        if (src_id.size() > 255 || dest_id.size() > 255 ||
+            cap < DVB_HEADER_LEN + src_id.size() + 1 + dest_id.size() + 1) return 0;
+        size_t n = 0;
+        buf[n++] = (char) DVB_MAGIC;
+        buf[n++] = DVB_VERSION;
+        buf[n++] = (char) DVB_SEQREQ;
+        buf[n++] = (char) caps;
+        buf[n++] = (char) src_id.size();
+        memcpy(buf + n, src_id.data(), src_id.size());
+        n += src_id.size();
+        buf[n++] = (char) dest_id.size();
+        memcpy(buf + n, dest_id.data(), dest_id.size());
+        n += dest_id.size();
+        size_t k = put_varint(buf + n, cap - n - 1, seqno);
+        if (k == 0) return 0;
+        n += k;
+        buf[n++] = (char) hops;
+        return n;
+    }
+    
+    // encode a hello; returns the encoded length, 0 if it does not fit
+    static size_t toHello(char* buf, size_t cap, const string& src_id, uint8_t caps,
+                          uint32_t interval_ms, uint8_t mult)
+    {
+        if (src_id.size() > 255 || cap < DVB_HEADER_LEN + src_id.size() + 1) return 0;
+        size_t n = 0;
+        buf[n++] = (char) DVB_MAGIC;
+        buf[n++] = DVB_VERSION;
+        buf[n++] = (char) DVB_HELLO;
+        buf[n++] = (char) caps;
+        buf[n++] = (char) src_id.size();
+        memcpy(buf + n, src_id.data(), src_id.size());
+        n += src_id.size();
+        size_t k = put_varint(buf + n, cap - n - 1, interval_ms);
+        if (k == 0) return 0;
+        n += k;
+        buf[n++] = (char) mult;
+        return n;
+    }
+    
+    static bool isBinary(const char* buf, size_t len)
+    {
+        return len >= DVB_HEADER_LEN && (uint8_t) buf[0] == DVB_MAGIC;
+    }
+    
+    // decode a binary message into msg, reusing its storage; new destinations are interned
+    static bool fromBinary(const char* buf, size_t len, IdTable& ids, DVMsg& msg)
+    {
+        DVReader reader;
+        if (!reader.open(buf, len)) return false;
+        msg.src_id.assign(reader.src, reader.src_len);
+        msg.caps = reader.caps;
+        msg.type = reader.type;
+        msg.base = reader.base;
+        msg.version = reader.version;
+        msg.entries.clear();
+        const char* dest;
+        size_t dest_len;
+        int cost;
+        while (reader.next(dest, dest_len, cost))
+            msg.entries.push_back(DVEntry(ids.intern(dest, dest_len), cost, reader.seqno));
+        return reader.ok();
+    }
+    
+    // Zero-allocation cursor over a binary message; entries point into the datagram
+    struct DVReader {
+        bool open(const char* buf, size_t len)
+        {
+            p = buf;
+            end = buf + len;
+            base = version = remaining = hello_interval = 0;
+            hello_mult = 0;
+            seqno = 0;
+            req_dest = NULL;
+            req_dest_len = 0;
+            req_hops = 0;
+            error = true;
+            if (!isBinary(buf, len) || (uint8_t) buf[1] != DVB_VERSION) return false;
+            type = (uint8_t) buf[2];
+            caps = (uint8_t) buf[3];
+            src_len = (uint8_t) buf[4];
+            p += DVB_HEADER_LEN;
+            if ((size_t) (end - p) < src_len) return false;
+            src = p;
+            p += src_len;
+            
+            if (type == DVB_DELTA && !read_varint(base)) return false;
+            if ((type == DVB_FULL || type == DVB_DELTA || type == DVB_ACK) && !read_varint(version))
+                return false;
+            if ((type == DVB_FULL || type == DVB_DELTA) && !read_varint(remaining))
+                return false;
+            if (type == DVB_HELLO)
+            {
+                if (!read_varint(hello_interval) || p == end) return false;
+                hello_mult = (uint8_t) *p++;
+            }
+            if (type == DVB_SEQREQ)
+            {
+                if (p == end) return false;
+                req_dest_len = (uint8_t) *p++;
+                if ((size_t) (end - p) < req_dest_len) return false;
+                req_dest = p;
+                p += req_dest_len;
+                uint32_t v;
+                if (!read_varint(v) || p == end) return false;
+                seqno = (uint16_t) v;
+                req_hops = (uint8_t) *p++;
+            }
+            if (type < DVB_FULL || type > DVB_SEQREQ) return false;
+            error = false;
+            return true;
+        }
+        
+        bool next(const char*& dest, size_t& dest_len, int& cost)
+        {
+            if (error || remaining == 0) return false;
+            if (p == end) { error = true; return false; }
+            dest_len = (uint8_t) *p++;
+            if ((size_t) (end - p) < dest_len) { error = true; return false; }
+            dest = p;
+            p += dest_len;
+            uint32_t v;
+            if (!read_varint(v)) { error = true; return false; }
+            cost = (int) min(v, (uint32_t) INF);
+            if ((caps & CAP_SEQNO) && !read_varint(v)) { error = true; return false; }
+            seqno = (caps & CAP_SEQNO) ? (uint16_t) v : 0;
+            remaining--;
+            return true;
+        }
+        
+        bool ok() const { return !error && remaining == 0; }
+        
+        bool read_varint(uint32_t& v)
+        {
+            size_t k = get_varint(p, end - p, v);
+            p += k;
+            return k > 0;
+        }
+        
+        uint8_t type;
+        uint8_t caps;
+        const char* src;
+        size_t src_len;
+        uint32_t base;
+        uint32_t version;
+        const char* p;
+        const char* end;
+        uint32_t remaining;
+        uint32_t hello_interval; // DVB_HELLO: sender's interval in ms
+        uint8_t hello_mult; // DVB_HELLO: sender's detect multiplier
+        uint16_t seqno; // sequence number of the last entry read, or DVB_SEQREQ's
+        const char* req_dest; // DVB_SEQREQ: destination whose sequence number is wanted
+        size_t req_dest_len;
+        uint8_t req_hops; // DVB_SEQREQ: hops the request may still travel
+        bool error;
+    };
+    
+    string src_id; // id of node that send the DV
+    vector<DVEntry> entries; // Distance vector
+    uint8_t caps; // sender's capability bits
+    uint8_t type; // DVB_* message type (text messages are always DVB_FULL)
+    uint32_t base; // DVB_DELTA: version the delta is relative to
+    uint32_t version; // sender's DV version this message brings the receiver up to
+};
+
+inline vector<string> my_split(string str, int num_parts, string delimit)
+{
+    vector<string> res;
+    size_t pos_pre = 0;
+    while (num_parts > 1)
+    {
+        size_t pos = str.find_first_of(delimit, pos_pre);
+        if (pos == string::npos) break;
+        
+        string sub = str.substr(pos_pre, pos - pos_pre);
+        boost::algorithm::trim(sub);
+        pos_pre = pos + 1;
+        if (sub.length() == 0) continue;
+        
+        res.push_back(sub);
+        num_parts--;
+    }
+    
+    string sub = str.substr(pos_pre);
+    if (sub.length() > 0)
+        res.push_back(sub);
+    
+    return res;
+}
+
+// Message types as counted by the host's metrics
+enum MsgKind { MSG_DV, MSG_COST, MSG_DATA, MSG_HELLO, MSG_CONTROL, MSG_OTHER, MSG_KINDS };
+static const char* const msg_kind_names[MSG_KINDS] = { "dv", "cost", "data", "hello", "control", "other" };
+
+// control covers the binary acks, resync and seqno requests
+inline MsgKind message_kind(const char* msg, size_t len)
+{
+    if (len >= DVB_HEADER_LEN && (uint8_t) msg[0] == DVB_MAGIC)
+    {
+        uint8_t type = (uint8_t) msg[2];
+        if (type == DVB_FULL || type == DVB_DELTA) return MSG_DV;
+        return type == DVB_HELLO ? MSG_HELLO : MSG_CONTROL;
+    }
+    if (len >= 3 && memcmp(msg, "dv:", 3) == 0) return MSG_DV;
+    if (len >= 5 && memcmp(msg, "cost:", 5) == 0) return MSG_COST;
+    if (len >= 5 && memcmp(msg, "data:", 5) == 0) return MSG_DATA;
+    return MSG_OTHER;
+}
+
+// Fields of a data message "data:<dest>:<src>[/<flow>]:<payload>", parsed in
+// place so a relay can look up the destination without copying the datagram.
+// The optional flow label tells apart flows between the same two routers.
+struct DataHeader {
+    // false if msg is not a data message
+    bool parse(const char* msg, size_t len)
+    {
+        if (len < 5 || memcmp(msg, "data:", 5) != 0) return false;
+        const char* end = msg + len;
+        dest = msg + 5;
+        const char* colon = (const char*) memchr(dest, ':', end - dest);
+        if (!colon || colon == dest) return false;
+        dest_len = colon - dest;
+        src = colon + 1;
+        colon = (const char*) memchr(src, ':', end - src);
+        if (!colon) return false;
+        src_len = colon - src;
+        const char* slash = (const char*) memchr(src, '/', src_len);
+        flow = slash ? slash + 1 : colon;
+        flow_len = colon - flow;
+        if (slash) src_len = slash - src;
+        payload = colon + 1;
+        payload_len = end - payload;
+        return true;
+    }
+    
+    // FNV-1a of (src, dest, flow): the same at every router along the path
+    size_t flow_hash() const
+    {
+        uint32_t h = 2166136261u;
+        mix(h, src, src_len);
+        mix(h, dest, dest_len);
+        mix(h, flow, flow_len);
+        return h ^ (h >> 16); // fold the high bits into the ones a modulo uses
+    }
+    
+    static void mix(uint32_t& h, const char* p, size_t len)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            h ^= (uint8_t) p[i];
+            h *= 16777619u;
+        }
+        h ^= 0xFF; // field separator
+        h *= 16777619u;
+    }
+    
+    const char* dest;
+    size_t dest_len;
+    const char* src;
+    size_t src_len;
+    const char* flow; // empty if the message has no flow label
+    size_t flow_len;
+    const char* payload;
+    size_t payload_len;
+};
+
+// Full-table advertisement encoded once per broadcast. The per-neighbor
+// message only rewrites the entries poisoned reverse hides from that neighbor.
+struct DVAdvert {
+    DVAdvert() : built(false) {}
+    
+    // encode dvm once; entries routed through a neighbor are remembered for poisoning
+    bool build(const DVMsg& dvm, const IdTable& ids, const Rib& rib, bool binary,
+               char* scratch, size_t scratch_len)
+    {
+        built = true;
+        base.clear();
+        cost_spans.clear();
+        poisoned.clear();
+        
+        if (binary)
+        {
+            size_t len = dvm.toBinary(scratch, scratch_len, ids, &cost_spans);
+            if (len == 0) return false;
+            base.assign(scratch, len);
+            size_t k = put_varint(scratch, scratch_len, INF);
+            inf_cost.assign(scratch, k);
+        }
+        else
+        {
+            base = "dv:" + dvm.toString(ids, &cost_spans);
+            for (auto& span : cost_spans)
+            {
+                span.first += 3;
+                span.second += 3;
+            }
+            inf_cost = to_string(INF);
+        }
+        
+        for (size_t i = 0; i < dvm.entries.size(); i++)
+        {
+            uint32_t next_hop = rib.next_hop[dvm.entries[i].dest];
+            if (next_hop != NO_ID)
+                poisoned[next_hop].push_back(i);
+        }
+        return true;
+    }
+    
+    // the message for one neighbor: neighbors with nothing to poison share one
+    // slab holding the base message, the others get INF spliced over their entries
+    SendBuffer encode_for(uint32_t neighbor, BufferPool& pool)
+    {
+        auto p = poisoned.find(neighbor);
+        if (p == poisoned.end())
+        {
+            if (shared.empty()) shared = pool.copy(base.data(), base.size());
+            return shared;
+        }
+        
+        SendBuffer message = pool.get(base.size() + p->second.size() * inf_cost.size());
+        char* out = message.data();
+        size_t last = 0;
+        for (size_t i : p->second)
+        {
+            memcpy(out, base.data() + last, cost_spans[i].first - last);
+            out += cost_spans[i].first - last;
+            memcpy(out, inf_cost.data(), inf_cost.size());
+            out += inf_cost.size();
+            last = cost_spans[i].second;
+        }
+        memcpy(out, base.data() + last, base.size() - last);
+        out += base.size() - last;
+        message.resize(out - message.data());
+        return message;
+    }
+    
+    bool built;
+    string base; // encoded full table
+    SendBuffer shared; // base in a send slab, once a neighbor without poisoned entries needs it
+    string inf_cost; // INF in this encoding
+    vector<pair<size_t,size_t> > cost_spans; // offset of each entry's cost within base
+    map<uint32_t, vector<size_t> > poisoned; // next hop => entries routed through it
+};
+
+// Routing events counted by a DVCore for the host's metrics
+struct CoreStats {
+    CoreStats() : triggered_updates(0), periodic_updates(0), route_changes(0), fast_reroutes(0), seqno_requests(0) {}
+    
+    uint64_t triggered_updates; // broadcasts caused by a route change
+    uint64_t periodic_updates; // broadcasts every DV_SEND_SEC
+    uint64_t route_changes; // routing table entries installed
+    uint64_t fast_reroutes; // routes moved to a loop-free alternate
+    uint64_t seqno_requests; // loop-free mode: requests sent or forwarded
+};
+
+// What a DVCore needs from the process hosting it. DVRouter implements it
+// with a UDP socket and asio timers, the simulator with a virtual network
+// and clock.
+class DVHost {
+public:
+    virtual ~DVHost() {}
+    
+    // deliver a datagram to the router listening on port
+    virtual void send(uint16_t port, const SendBuffer& message) = 0;
+    
+    // (re)start the neighbor's failure timer; when it runs out the host
+    // calls DVCore::neighbor_timeout
+    virtual void arm_fail_timer(shared_ptr<Interface> interface, int ms) = 0;
+    
+    // stop the neighbor's failure timer: it is no longer a neighbor
+    virtual void cancel_fail_timer(shared_ptr<Interface> interface) = 0;
+    
+    // start the triggered-update hold-down timer; when it runs out the host
+    // calls DVCore::on_hold_timer
+    virtual void arm_hold_timer(int ms) = 0;
+    
+    // dest's route was installed or changed; NO_ID if only equal-cost next
+    // hops did (ECMP)
+    virtual void routes_changed(uint32_t dest) {}
+};
+
+// State any number of DVCores on one thread can share. A router process has
+// its own; the simulator runs all of its routers against one so every name
+// is interned once and send slabs are recycled across routers.
+struct DVShared {
+    DVShared(size_t slab_size = MAX_DV_LENGTH) : send_pool(slab_size), encode_buffer(MAX_DV_LENGTH) {}
+    
+    IdTable ids; // router name <=> index
+    BufferPool send_pool; // slabs for outgoing datagrams
+    vector<char> encode_buffer; // scratch space for binary DV encoding
+};
+
+// Distance-vector routing for one router
+class DVCore
+{
+public:
+    DVCore(DVHost& host, string id, uint16_t local_port, map<string, shared_ptr<Interface> > neighbors,
+           CoreOptions options, DVShared& shared, AsyncLog& mylog)
+    : host(host), id(id), local_port(local_port), neighbors(neighbors), options(options), shared(shared), ids(shared.ids),
+    mylog(mylog), dv_version(0), dv_rounds(0), holding(false), dirty(false),
+    jitter_rng(IdTable::hash(id.data(), id.size()))
+    {
+        rib.max_paths = (size_t) max(1, min(options.ecmp, MAX_ECMP));
+        rib.loop_free = options.loop_free;
+        self = intern(id);
+        
+        // initialize its own distance vector and routing table (only know neighbors' info)
+        for (auto& i : neighbors)
+        {
+            shared_ptr<Interface> interface = i.second;
+            interface->idx = intern(i.first);
+            iface_of[interface->idx] = interface;
+        }
+        // one Adj-RIB-In row per neighbor, in name order so ties go to the smallest id
+        for (auto& i : neighbors)
+        {
+            i.second->row = row_iface.size();
+            row_iface.push_back(i.second);
+        }
+        sync_ids();
+        for (auto& i : neighbors)
+        {
+            shared_ptr<Interface> interface = i.second;
+            row_of[interface->idx] = (int32_t) interface->row;
+            rib_in.row(interface->row)[interface->idx] = 0; // a neighbor is zero away from itself
+            if (options.loop_free) rib_seq.row(interface->row)[interface->idx] = 0;
+            set_route(interface->idx, interface->cost, interface->idx);
+        }
+        
+        minplus = select_minplus_kernel(&minplus_name);
+        logtime();
+        mylog << "Using the " << minplus_name << " route recompute kernel." << endl << endl;
+        set_route(self, 0, NO_ID); // dv to itself is zero
+    }
+    
+    // full forces a complete DV even to neighbors that take deltas
+    void broadcast_dv(bool full = false)
+    {
+        // one base encoding per wire format, shared by every neighbor
+        DVAdvert text_advert, binary_advert;
+        for (auto& i : neighbors)
+        {
+            if (!full && takes_delta(i.second))
+                send_delta(i.second);
+            else
+                send_dv(i.second, text_advert, binary_advert);
+        }
+    }
+    
+    void send_dv(shared_ptr<Interface> interface)
+    {
+        DVAdvert text_advert, binary_advert;
+        send_dv(interface, text_advert, binary_advert);
+    }
+    
+    void send_dv(shared_ptr<Interface> interface, DVAdvert& text_advert, DVAdvert& binary_advert)
+    {
+        // pick the wire format negotiated with this neighbor
+        DVAdvert* advert = &text_advert;
+        if (interface->peer_caps & CAP_BINARY)
+        {
+            if (!binary_advert.built)
+                binary_advert.build(full_dv(), ids, rib, true, shared.encode_buffer.data(), shared.encode_buffer.size());
+            if (!binary_advert.base.empty())
+                advert = &binary_advert;
+        }
+        if (advert == &text_advert && !text_advert.built)
+            text_advert.build(full_dv(), ids, rib, false, NULL, 0);
+        
+        send(advert->encode_for(interface->idx, shared.send_pool), interface->port);
+    }
+    
+    // send the entries changed since the neighbor's last acknowledged version
+    void send_delta(shared_ptr<Interface> interface)
+    {
+        DVMsg dvm(id, my_caps());
+        dvm.type = DVB_DELTA;
+        dvm.base = interface->acked_version;
+        dvm.version = dv_version;
+        for (auto it = change_log.upper_bound(interface->acked_version); it != change_log.end(); ++it)
+        {
+            uint32_t dest = it->second;
+            bool poisoned = rib.next_hop[dest] == interface->idx || provisional(dest);
+            dvm.entries.push_back(entry_for(dest, poisoned ? INF : rib.distance[dest]));
+        }
+        
+        size_t len = dvm.toBinary(shared.encode_buffer.data(), shared.encode_buffer.size(), ids);
+        if (len == 0) // too large for one datagram, fall back to a full DV
+        {
+            send_dv(interface);
+            return;
+        }
+        send(shared.send_pool.copy(shared.encode_buffer.data(), len), interface->port);
+    }
+    
+    void change_cost(string neighbor_id, int new_cost, bool reciprocal, bool temp)
+    {
+        if (neighbors.count(neighbor_id) == 0)
+        {
+            mylog.at(LOG_ERROR);
+            logtime();
+            mylog << neighbor_id << " is not a neighbor." << endl << endl;
+            return;
+        }
+        shared_ptr<Interface> interface = neighbors[neighbor_id];
+        
+        if ((temp && !interface->down) || (!temp && interface->cost != new_cost))
+        {
+            logtime();
+            mylog << "Cost " << id << neighbor_id << " changed from "
+            << link_cost(interface) << " to " << new_cost << endl << endl;
+            
+            bool has_change;
+            if (temp)
+            {
+                // only routes through the failed neighbor change: switch them to their
+                // alternates at once, and recompute just the ones without one
+                interface->down = true;
+                has_change = fast_reroute(interface);
+            }
+            else
+            {
+                interface->cost = new_cost;
+                // every destination may now be reached best through another neighbor
+                has_change = recompute_all(NULL);
+            }
+            
+            //            broadcast(dvmsg());
+            if (has_change)
+                trigger_update();
+            
+            if (reciprocal)
+            {
+                send("cost:" + neighbor_id + ":" + id + ":" + to_string(new_cost), interface->port);
+            }
+        }
+        else
+        {
+            logtime();
+            mylog << "Cost is not changed." << endl << endl;
+        }
+    }
+    
+    // Live reconfiguration: make the neighbors match wanted, e.g. a reloaded
+    // topology file, adding, updating and removing them in place. Only the
+    // routes that change are advertised.
+    void reconfigure(const map<string, shared_ptr<Interface> >& wanted)
+    {
+        vector<string> gone;
+        for (auto& i : neighbors)
+        {
+            if (wanted.count(i.first) == 0) gone.push_back(i.first);
+        }
+        for (auto& name : gone)
+            remove_neighbor(name);
+        for (auto& i : wanted)
+            add_neighbor(i.first, i.second->port, i.second->cost);
+    }
+    
+    // add a neighbor, or update the port and cost of an existing one
+    void add_neighbor(const string& neighbor_id, uint16_t port, int cost)
+    {
+        if (neighbor_id == id) return;
+        auto existing = neighbors.find(neighbor_id);
+        if (existing != neighbors.end())
+        {
+            shared_ptr<Interface> interface = existing->second;
+            if (interface->port != port)
+            {
+                logtime();
+                mylog << "Port of " << neighbor_id << " changed from " << interface->port << " to " << port << endl << endl;
+                interface->port = port;
+                // same routes, new port: only the forwarding entries change
+                for (uint32_t dest = 0; dest < rib.size(); dest++)
+                {
+                    if (rib.next_hop[dest] != interface->idx) continue;
+                    rib.dest_port[dest] = port;
+                    host.routes_changed(dest);
+                }
+                find_alternates(); // equal-cost next hops carry their port
+            }
+            if (interface->cost != cost)
+                change_cost(neighbor_id, cost, false, false);
+            return;
+        }
+        
+        shared_ptr<Interface> interface(new Interface(port, neighbor_id, cost));
+        interface->idx = intern(neighbor_id);
+        // reuse a removed neighbor's row; a new row comes last, so ties no
+        // longer go to the smallest id for this neighbor
+        if (free_rows.empty())
+        {
+            interface->row = row_iface.size();
+            row_iface.push_back(interface);
+            sync_ids();
+        }
+        else
+        {
+            interface->row = free_rows.back();
+            free_rows.pop_back();
+            row_iface[interface->row] = interface;
+        }
+        neighbors[neighbor_id] = interface;
+        iface_of[interface->idx] = interface;
+        row_of[interface->idx] = (int32_t) interface->row;
+        int32_t* row = rib_in.row(interface->row);
+        fill(row, row + rib_in.cols, (int32_t) INF);
+        row[interface->idx] = 0; // a neighbor is zero away from itself
+        if (options.loop_free)
+        {
+            int32_t* seqnos = rib_seq.row(interface->row);
+            fill(seqnos, seqnos + rib_seq.cols, 0);
+        }
+        
+        logtime();
+        mylog << "Added neighbor " << neighbor_id << " on port " << port << " with cost " << cost << endl << endl;
+        // its own DV brings the rest; ours tells it what we reach right away
+        if (recompute(interface->idx, NULL))
+            trigger_update();
+        send_dv(interface);
+    }
+    
+    void remove_neighbor(const string& neighbor_id)
+    {
+        if (neighbors.count(neighbor_id) == 0)
+        {
+            mylog.at(LOG_ERROR);
+            logtime();
+            mylog << neighbor_id << " is not a neighbor." << endl << endl;
+            return;
+        }
+        shared_ptr<Interface> interface = neighbors[neighbor_id];
+        logtime();
+        mylog << "Removed neighbor " << neighbor_id << endl << endl;
+        host.cancel_fail_timer(interface);
+        
+        // as for a failure: routes through it move to their alternates
+        bool has_change = false;
+        if (!interface->down)
+        {
+            interface->down = true;
+            has_change = fast_reroute(interface);
+        }
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            // what is still left pointing at it has no route
+            if (rib.next_hop[dest] == interface->idx)
+            {
+                set_route(dest, INF, NO_ID);
+                has_change = true;
+            }
+        }
+        int32_t* row = rib_in.row(interface->row);
+        fill(row, row + rib_in.cols, (int32_t) INF);
+        free_rows.push_back(interface->row);
+        row_of[interface->idx] = -1;
+        iface_of.erase(interface->idx);
+        neighbors.erase(neighbor_id);
+        
+        if (has_change)
+            trigger_update();
+    }
+    
+    // periodic advertisement; the host calls it every DV_SEND_SEC
+    void on_dv_timer()
+    {
+        //        broadcast(dvmsg());
+        // neighbors on deltas get a (usually empty) delta as a keepalive and a full DV every DV_FULL_SEC
+        dv_rounds++;
+        counters.periodic_updates++;
+        dirty = false; // this advertisement carries any change still held back
+        if (options.loop_free)
+            retry_seqno_requests();
+        broadcast_dv(dv_rounds % (DV_FULL_SEC / DV_SEND_SEC) == 0);
+    }
+    
+    // the hold-down window ended: send what changed during it, and hold again
+    void on_hold_timer()
+    {
+        holding = false;
+        if (dirty)
+        {
+            dirty = false;
+            send_triggered();
+        }
+    }
+    
+    // periodic hello to every neighbor, down or not, so a recovered link is
+    // noticed; the host calls it every hello_ms
+    void on_hello_timer()
+    {
+        if (hello.empty())
+        {
+            size_t len = DVMsg::toHello(shared.encode_buffer.data(), shared.encode_buffer.size(), id, my_caps(),
+                                        options.hello_ms, (uint8_t) options.hello_mult);
+            hello = shared.send_pool.copy(shared.encode_buffer.data(), len);
+        }
+        for (auto& i : neighbors)
+            send(hello, i.second->port);
+    }
+    
+    // the neighbor's failure timer ran out: treat the link as down until it is heard from again
+    void neighbor_timeout(shared_ptr<Interface> interface)
+    {
+        string src_id = interface->neighbor_id;
+        
+        logtime();
+        if (interface->hello_detect_ms)
+            mylog << "Have not received hello from " << src_id << " for " << interface->hello_detect_ms << " ms. " << flush;
+        else
+            mylog << "Have not received DV from " << src_id << " for " << FAIL_SEC << " seconds. " << flush;
+        mylog << "Mark DV to " << src_id << " as Inf." << endl << endl;
+        interface->hello_detect_ms = 0; // the session is down; DVs keep time until hellos resume
+        
+        bool dump = mylog.enabled(LOG_DEBUG);
+        if (dump)
+        {
+            mylog << "******************* ";
+            logtime();
+            mylog << " *******************" << endl;
+            
+            mylog << "The routing table before change is:" << endl;
+            print_routetable();
+            mylog << endl;
+        }
+        
+        change_cost(src_id, INF, false, true);
+        
+        if (dump)
+        {
+            mylog << "The routing table after change is:" << endl;
+            print_routetable();
+            
+            mylog << "*******************------------------------*******************" << endl;
+            mylog << endl << endl;
+        }
+    }
+    
+    // a DV or cost-change message from a neighbor
+    void handle_control(const char* message, size_t len)
+    {
+        if (DVMsg::isBinary(message, len) && (uint8_t) message[2] == DVB_HELLO)
+        {
+            handle_hello(message, len);
+            return;
+        }
+        if (DVMsg::isBinary(message, len) && (uint8_t) message[2] == DVB_SEQREQ)
+        {
+            handle_seqno_request(message, len);
+            return;
+        }
+        if (DVMsg::isBinary(message, len)) // binary dv message
+        {
+            if (DVMsg::fromBinary(message, len, ids, rx_dv))
+                handle_dv(rx_dv);
+            return;
+        }
+        
+        string recv_str(message, len);
+        vector<string> tokens = my_split(recv_str, 2, ":");
+        tokens.resize(2);
+        
+        string tag = tokens[0];
+        
+        if (tag.compare("cost") == 0)
+        {
+            tokens = my_split(tokens[1], 3, ":");
+            tokens.resize(3);
+            string dest_id = tokens[0];
+            string src_id = tokens[1];
+            int cost = atoi(tokens[2].c_str());
+            
+            if (dest_id.compare(id) == 0) // I am the destination
+            {
+                logtime();
+                mylog << id << " received cost change from " << src_id << endl << endl;
+                change_cost(src_id, cost, false, false);
+            }
+        }
+        else if (tag.compare("dv") == 0)  // dv message
+        {
+            DVMsg::fromString(tokens[1], ids, rx_dv);
+            handle_dv(rx_dv);
+        }
+    }
+    
+    bool has_route(uint32_t dest)
+    {
+        return dest != NO_ID && dest < rib.size() && rib.next_hop[dest] != NO_ID;
+    }
+    
+    const string& router_id() const { return id; }
+    uint32_t self_index() const { return self; }
+    const IdTable& names() const { return ids; }
+    const Rib& routes() const { return rib; }
+    const CoreStats& stats() const { return counters; }
+    const map<string, shared_ptr<Interface> >& interfaces() const { return neighbors; }
+    
+    // memory held by the routing table, the Adj-RIB-In and the delta change log.
+    // None of them shrinks, so this is also the peak so far.
+    size_t table_bytes() const
+    {
+        const size_t map_node = 4 * sizeof(void*); // red-black tree node overhead
+        return rib.bytes() + rib_in.bytes() + rib_seq.bytes() + requested.capacity() * sizeof(int32_t) +
+               change_log.size() * (map_node + 2 * sizeof(uint32_t));
+    }
+    
+    // Warm start: the neighbors' last DVs, from which a restarted router
+    // recomputes this routing table (see Snapshot.h)
+    void snapshot(RouteSnapshot::Builder& out)
+    {
+        for (uint32_t i = 0; i < ids.size(); i++) out.add_name(ids.name(i));
+        out.set_owner(self, options.loop_free ? rib.seqno[self] : 0);
+        for (auto& interface : row_iface)
+        {
+            if (interface->down) continue; // its row is stale
+            out.add_row(interface->idx);
+            const int32_t* row = rib_in.row(interface->row);
+            for (uint32_t dest = 0; dest < ids.size(); dest++)
+            {
+                if (row[dest] < INF)
+                    out.add_entry(dest, row[dest], options.loop_free ? seqno_via(interface->row, dest) : 0);
+            }
+        }
+    }
+    
+    // load the rows of a snapshot we wrote and install the routes they give at
+    // once. The routes are provisional: forwarded on but not advertised until
+    // their neighbor's first DV replaces its row, and dropped with it if that
+    // neighbor stays silent for FAIL_SEC. Returns the routes installed.
+    size_t restore(const RouteSnapshot& snap)
+    {
+        if (snap.name(snap.self()) != id) return 0;
+        vector<uint32_t> index(snap.name_count());
+        for (uint32_t i = 0; i < snap.name_count(); i++) index[i] = ids.intern(snap.name(i));
+        sync_ids();
+        
+        size_t rows = 0;
+        for (size_t r = 0; r < snap.row_count(); r++)
+        {
+            uint32_t neighbor = index[snap.row(r).neighbor];
+            if (iface_of.count(neighbor) == 0) continue; // no longer a neighbor
+            shared_ptr<Interface> interface = iface_of[neighbor];
+            interface->provisional = true;
+            int32_t* row = rib_in.row(interface->row);
+            int32_t* seqnos = options.loop_free ? rib_seq.row(interface->row) : NULL;
+            for (const RouteSnapshot::Entry* e = snap.entries_begin(r); e != snap.entries_end(r); e++)
+            {
+                row[index[e->dest]] = min(max(e->cost, 0), INF);
+                if (seqnos) seqnos[index[e->dest]] = (uint16_t) e->seqno;
+            }
+            row[neighbor] = 0;
+            host.arm_fail_timer(interface, FAIL_SEC * 1000);
+            rows++;
+        }
+        // a newer seqno than any route to us still around from before the restart
+        if (options.loop_free)
+            rib.seqno[self] = (uint16_t) (snap.seqno() + 1);
+        if (rows == 0) return 0;
+        
+        recompute_all(NULL);
+        size_t routes = 0;
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            if (dest != self && has_route(dest) && rib.distance[dest] < INF) routes++;
+        }
+        logtime();
+        mylog << "Warm start: " << routes << " routes restored from the DVs of " << rows << " neighbors, "
+        << time(NULL) - (time_t) snap.saved_at() << " seconds old, provisional until they are heard from." << endl << endl;
+        return routes;
+    }
+    
+    void print_routetable()
+    {
+        // list destinations by name, as the map-based table used to
+        vector<uint32_t> order;
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            if (has_route(dest)) order.push_back(dest);
+        }
+        sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return ids.name(a) < ids.name(b); });
+        
+        mylog << "Destination\tDistance\tOutgoing UDP port\tDestination UDP port" << endl;
+        for (uint32_t dest : order)
+        {
+            string cost_str = "Inf";
+            if (rib.distance[dest] < INF)
+                cost_str = to_string(rib.distance[dest]);
+            mylog << ids.name(dest) << "\t\t" << cost_str << "\t\t" << local_port
+            << "(Node "+ id + ")" << "\t\t" << rib.dest_port[dest] << "(Node " + ids.name(rib.next_hop[dest]) + ")" << endl;
+        }
+    }
+    
+    void logtime()
+    {
+        mylog << " [" << mylog.timestamp() << "] ";
+    }
+    
+private:
+    uint8_t my_caps()
+    {
+        return CAP_BINARY | (options.delta ? CAP_DELTA : 0) | (options.loop_free ? CAP_SEQNO : 0);
+    }
+    
+    // delta mode needs both ends to opt in and a version the neighbor has acknowledged
+    bool takes_delta(shared_ptr<Interface> interface)
+    {
+        return options.delta && (interface->peer_caps & (CAP_BINARY | CAP_DELTA)) == (CAP_BINARY | CAP_DELTA) &&
+               interface->acked_version > 0;
+    }
+    
+    // index of a router name, growing the per-router arrays for a new one
+    uint32_t intern(const string& name)
+    {
+        uint32_t idx = ids.intern(name);
+        sync_ids();
+        return idx;
+    }
+    
+    void sync_ids()
+    {
+        if (rib.size() < ids.size())
+        {
+            rib.resize(ids.size());
+            row_of.resize(ids.size(), -1);
+            if (options.loop_free) requested.resize(ids.size(), -1);
+        }
+        if (rib_in.rows != row_iface.size() || rib_in.cols < ids.size())
+        {
+            rib_in.resize(row_iface.size(), ids.size());
+            if (options.loop_free) rib_seq.resize(row_iface.size(), ids.size());
+        }
+    }
+    
+    int link_cost(shared_ptr<Interface> interface)
+    {
+        return interface->down ? INF : interface->cost;
+    }
+    
+    // routed through a neighbor not heard from since a warm start; the route
+    // to the neighbor itself comes from the topology, not the snapshot
+    bool provisional(uint32_t dest)
+    {
+        uint32_t next_hop = rib.next_hop[dest];
+        return next_hop != NO_ID && next_hop != dest && iface_of[next_hop]->provisional;
+    }
+    
+    // re-run Bellman-Ford for dest over every neighbor's last DV. cause is the
+    // DV that triggered it, if any
+    bool recompute(uint32_t dest, const DVMsg* cause)
+    {
+        if (dest == self) return false;
+        
+        // rows are ordered by neighbor name, so ties go to the smallest id
+        int32_t best = INF;
+        int32_t best_row = -1;
+        if (options.loop_free)
+            select_feasible(dest, best, best_row);
+        else
+        {
+            for (size_t n = 0; n < rib_in.rows; n++)
+            {
+                int32_t distance = min(link_cost(row_iface[n]) + rib_in.row(n)[dest], INF);
+                if (distance < best)
+                {
+                    best = distance;
+                    best_row = (int32_t) n;
+                }
+            }
+        }
+        bool changed = update_route(dest, best, best_row, cause);
+        find_alternate(dest);
+        return changed;
+    }
+    
+    // recompute every destination with the min-plus kernel; only the
+    // destinations whose route changed are logged and installed
+    bool recompute_all(const DVMsg* cause)
+    {
+        row_cost.resize(rib_in.rows);
+        for (size_t n = 0; n < rib_in.rows; n++)
+            row_cost[n] = link_cost(row_iface[n]);
+        best.resize(rib_in.stride);
+        best_row.resize(rib_in.stride);
+        minplus(rib_in.data(), rib_in.stride, rib_in.rows, row_cost.data(), best.data(), best_row.data());
+        
+        changed.clear();
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            if (dest == self) continue;
+            // the kernel picks the shortest route; loop-free mode falls back to
+            // a scan of the feasible ones when that is not one of them
+            if (options.loop_free && best_row[dest] >= 0 && !feasible(best_row[dest], dest))
+                select_feasible(dest, best[dest], best_row[dest]);
+            uint32_t next_hop = best_row[dest] < 0 ? rib.next_hop[dest] : row_iface[best_row[dest]]->idx;
+            if (best[dest] != rib.distance[dest] || next_hop != rib.next_hop[dest] ||
+                (options.loop_free && best_row[dest] >= 0 && seqno_via(best_row[dest], dest) != rib.seqno[dest]))
+                changed.push_back(dest);
+        }
+        
+        bool has_change = false;
+        for (uint32_t dest : changed)
+            has_change |= update_route(dest, best[dest], best_row[dest], cause);
+        find_alternates();
+        return has_change;
+    }
+    
+    // Loop-free alternates (RFC 5286): neighbor n is a safe backup for dest if
+    // D(n, dest) < D(n, self) + D(self, dest), i.e. n's own path to dest does not
+    // come back through us. The best such neighbor other than the primary is kept.
+    bool loop_free(size_t n, uint32_t dest)
+    {
+        const int32_t* r = rib_in.row(n);
+        return r[dest] < INF && (int64_t) r[dest] < (int64_t) r[self] + rib.distance[dest] &&
+               (!options.loop_free || feasible(n, dest));
+    }
+    
+    void find_alternate(uint32_t dest)
+    {
+        uint32_t primary = rib.next_hop[dest];
+        rib.alt_hop[dest] = NO_ID;
+        rib.alt_distance[dest] = INF;
+        start_paths(dest);
+        if (dest == self || primary == NO_ID) return;
+        for (size_t n = 0; n < rib_in.rows; n++)
+        {
+            if (row_iface[n]->idx == primary || row_iface[n]->down || !loop_free(n, dest)) continue;
+            int32_t distance = min(link_cost(row_iface[n]) + rib_in.row(n)[dest], INF);
+            if (distance == rib.distance[dest])
+                add_path(dest, row_iface[n]);
+            if (distance < rib.alt_distance[dest])
+            {
+                rib.alt_hop[dest] = row_iface[n]->idx;
+                rib.alt_distance[dest] = distance;
+            }
+        }
+        if (rib.max_paths > 1) host.routes_changed(NO_ID);
+    }
+    
+    // ECMP: the equal-cost next hops of dest start with its primary one;
+    // equal-cost neighbors are strictly closer to dest, so also loop-free
+    void start_paths(uint32_t dest)
+    {
+        if (rib.max_paths <= 1) return;
+        bool routed = dest != self && rib.next_hop[dest] != NO_ID && rib.distance[dest] < INF;
+        rib.path_count[dest] = routed ? 1 : 0;
+        rib.paths[dest * rib.max_paths] = rib.next_hop[dest];
+        rib.path_port[dest * rib.max_paths] = rib.dest_port[dest];
+    }
+    
+    void add_path(uint32_t dest, const shared_ptr<Interface>& interface)
+    {
+        if (rib.max_paths <= 1 || rib.path_count[dest] == 0 || rib.path_count[dest] >= rib.max_paths) return;
+        size_t i = dest * rib.max_paths + rib.path_count[dest]++;
+        rib.paths[i] = interface->idx;
+        rib.path_port[i] = interface->port;
+    }
+    
+    // every destination's alternate, one Adj-RIB-In row at a time
+    void find_alternates()
+    {
+        fill(rib.alt_hop.begin(), rib.alt_hop.end(), (uint32_t) NO_ID);
+        fill(rib.alt_distance.begin(), rib.alt_distance.end(), (int32_t) INF);
+        if (rib.max_paths > 1)
+        {
+            for (uint32_t dest = 0; dest < rib.size(); dest++) start_paths(dest);
+        }
+        for (size_t n = 0; n < rib_in.rows; n++)
+        {
+            shared_ptr<Interface> interface = row_iface[n];
+            if (interface->down) continue;
+            const int32_t* r = rib_in.row(n);
+            int64_t to_self = r[self];
+            int32_t cost = link_cost(interface);
+            for (uint32_t dest = 0; dest < rib.size(); dest++)
+            {
+                if (rib.next_hop[dest] == interface->idx || rib.next_hop[dest] == NO_ID || dest == self) continue;
+                if (r[dest] >= INF || (int64_t) r[dest] >= to_self + rib.distance[dest]) continue;
+                if (options.loop_free && !feasible(n, dest)) continue;
+                int32_t distance = min(cost + r[dest], INF);
+                if (distance == rib.distance[dest])
+                    add_path(dest, interface);
+                if (distance < rib.alt_distance[dest])
+                {
+                    rib.alt_hop[dest] = interface->idx;
+                    rib.alt_distance[dest] = distance;
+                }
+            }
+        }
+        if (rib.max_paths > 1) host.routes_changed(NO_ID);
+    }
+    
+    // Loop-free mode (Babel, RFC 8966): every destination originates a sequence
+    // number, and we keep a feasible distance, the best (seqno, distance) we have
+    // installed. A neighbor's route is feasible if its seqno is newer, or the
+    // same with a distance below ours: such a neighbor cannot be routing through
+    // us, so no installed route ever forms a loop. A destination left with
+    // only unfeasible routes is unreachable until it raises its seqno.
+    bool feasible(size_t n, uint32_t dest)
+    {
+        int32_t distance = rib_in.row(n)[dest];
+        if (distance >= INF) return false;
+        if (rib.fd_distance[dest] >= INF) return true; // never had a route
+        int newer = seqno_cmp(seqno_via(n, dest), rib.fd_seqno[dest]);
+        return newer > 0 || (newer == 0 && distance < rib.fd_distance[dest]);
+    }
+    
+    uint16_t seqno_via(size_t n, uint32_t dest)
+    {
+        return (uint16_t) rib_seq.row(n)[dest];
+    }
+    
+    // the shortest feasible route; an unfeasible one that is shorter asks
+    // dest for a new seqno, which makes it feasible once it arrives
+    void select_feasible(uint32_t dest, int32_t& best, int32_t& best_row)
+    {
+        best = INF;
+        best_row = -1;
+        int32_t unfeasible = INF;
+        for (size_t n = 0; n < rib_in.rows; n++)
+        {
+            int32_t distance = min(link_cost(row_iface[n]) + rib_in.row(n)[dest], INF);
+            if (distance >= INF) continue;
+            if (!feasible(n, dest))
+                unfeasible = min(unfeasible, distance);
+            else if (distance < best)
+            {
+                best = distance;
+                best_row = (int32_t) n;
+            }
+        }
+        if (unfeasible < best)
+            request_seqno(dest, (uint16_t) (rib.fd_seqno[dest] + 1), SEQREQ_HOPS, NO_ID);
+    }
+    
+    void install_seqno(uint32_t dest, uint16_t seqno, int32_t distance)
+    {
+        rib.seqno[dest] = seqno;
+        int newer = seqno_cmp(seqno, rib.fd_seqno[dest]);
+        if (rib.fd_distance[dest] >= INF || newer > 0 || (newer == 0 && distance < rib.fd_distance[dest]))
+        {
+            rib.fd_seqno[dest] = seqno;
+            rib.fd_distance[dest] = distance;
+        }
+    }
+    
+    DVEntry entry_for(uint32_t dest, int cost)
+    {
+        return DVEntry(dest, cost, options.loop_free ? rib.seqno[dest] : 0);
+    }
+    
+    // send a request for seqno towards dest, through the neighbor closest to it
+    // other than the one it came from; each (dest, seqno) is sent at most once
+    void request_seqno(uint32_t dest, uint16_t seqno, uint8_t hops, uint32_t from)
+    {
+        if (requested[dest] == seqno || hops == 0) return;
+        int32_t best = INF;
+        shared_ptr<Interface> toward;
+        for (size_t n = 0; n < rib_in.rows; n++)
+        {
+            shared_ptr<Interface> interface = row_iface[n];
+            if (interface->down || interface->idx == from || !(interface->peer_caps & CAP_BINARY)) continue;
+            if (rib_in.row(n)[dest] < best)
+            {
+                best = rib_in.row(n)[dest];
+                toward = interface;
+            }
+        }
+        if (!toward) return;
+        requested[dest] = seqno;
+        counters.seqno_requests++;
+        size_t len = DVMsg::toSeqnoRequest(shared.encode_buffer.data(), shared.encode_buffer.size(), id, my_caps(),
+                                           ids.name(dest), seqno, hops);
+        if (len == 0) return;
+        logtime();
+        mylog << "Request seqno " << seqno << " of " << ids.name(dest) << " through " << toward->neighbor_id
+        << "." << endl << endl;
+        send(shared.send_pool.copy(shared.encode_buffer.data(), len), toward->port);
+    }
+    
+    // ask again for the routes still held back by unfeasible shorter ones, in
+    // case a request was lost or went out before its destination was reachable
+    void retry_seqno_requests()
+    {
+        fill(requested.begin(), requested.end(), -1);
+        int32_t best, best_row;
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            if (dest != self) select_feasible(dest, best, best_row);
+        }
+    }
+    
+    // a destination raises its seqno to what is asked; a router that already has
+    // a route that new answers with its DV, any other passes the request on
+    void handle_seqno_request(const char* message, size_t len)
+    {
+        DVMsg::DVReader reader;
+        if (!options.loop_free || !reader.open(message, len)) return;
+        uint32_t src = ids.find(reader.src, reader.src_len);
+        uint32_t dest = ids.find(reader.req_dest, reader.req_dest_len);
+        if (src == NO_ID || iface_of.count(src) == 0 || dest == NO_ID) return;
+        shared_ptr<Interface> interface = iface_of[src];
+        
+        if (dest == self)
+        {
+            if (seqno_cmp(reader.seqno, rib.seqno[self]) <= 0) return;
+            logtime();
+            mylog << interface->neighbor_id << " asked for seqno " << reader.seqno << ", was " << rib.seqno[self]
+            << "." << endl << endl;
+            rib.seqno[self] = reader.seqno;
+            set_route(self, 0, NO_ID); // logs the change for deltas
+            trigger_update();
+            return;
+        }
+        if (dest < rib.size() && rib.distance[dest] < INF && rib.next_hop[dest] != src &&
+            seqno_cmp(rib.seqno[dest], reader.seqno) >= 0)
+        {
+            send_dv(interface);
+            return;
+        }
+        request_seqno(dest, reader.seqno, reader.req_hops - 1, src);
+    }
+    
+    // a neighbor went down: move every route through it to its alternate in
+    // one pass, before any message is exchanged; routes without one are
+    // recomputed from the remaining neighbors' DVs
+    bool fast_reroute(shared_ptr<Interface> failed)
+    {
+        changed.clear();
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            if (rib.next_hop[dest] == failed->idx) changed.push_back(dest);
+        }
+        
+        bool has_change = false;
+        size_t rerouted = 0;
+        for (uint32_t dest : changed)
+        {
+            uint32_t alt = rib.alt_hop[dest];
+            if (alt != NO_ID && !row_iface[row_of[alt]]->down)
+            {
+                set_route(dest, rib.alt_distance[dest], alt);
+                has_change = true;
+                rerouted++;
+                counters.fast_reroutes++;
+            }
+        }
+        if (rerouted > 0)
+        {
+            logtime();
+            mylog << "Fast reroute: " << rerouted << " of " << changed.size() << " routes through "
+            << failed->neighbor_id << " moved to loop-free alternates." << endl << endl;
+        }
+        for (uint32_t dest : changed)
+        {
+            // loop-free mode recomputes the rerouted ones too, in case a shorter
+            // route waits for a new seqno
+            if (rib.next_hop[dest] == failed->idx || options.loop_free) has_change |= recompute(dest, NULL);
+        }
+        find_alternates(); // alternates through the failed neighbor are gone
+        return has_change;
+    }
+    
+    // log and install the route through best_row (-1: unreachable) if it differs from the current one
+    bool update_route(uint32_t dest, int32_t distance, int32_t best_row, const DVMsg* cause)
+    {
+        shared_ptr<Interface> best_interface;
+        if (best_row >= 0) best_interface = row_iface[best_row];
+        
+        uint32_t next_hop = best_interface ? best_interface->idx : rib.next_hop[dest];
+        bool new_seqno = options.loop_free && best_row >= 0 && seqno_via(best_row, dest) != rib.seqno[dest];
+        if (distance == rib.distance[dest] && next_hop == rib.next_hop[dest] && !new_seqno) return false;
+        if (next_hop == NO_ID) return false; // still unreachable and never learned
+        
+        bool dump = mylog.enabled(LOG_DEBUG);
+        if (dump)
+        {
+            mylog << "******************* ";
+            logtime();
+            mylog << " *******************" << endl;
+            
+            mylog << "The routing table before change is:" << endl;
+            print_routetable();
+            mylog << endl;
+            
+            if (cause)
+                log_dv_cause(*cause, dest, rib_in.row(iface_of[ids.find(cause->src_id)]->row)[dest]);
+        }
+        
+        // update the DV and RouteTable
+        
+        string old_cost_str = "Inf";
+        if (rib.next_hop[dest] != NO_ID && rib.distance[dest] < INF)
+            old_cost_str = to_string(rib.distance[dest]);
+        
+        set_route(dest, distance, next_hop);
+        
+        if (!dump) logtime();
+        if (best_interface)
+        {
+            mylog << "Update " << id << " distance to " << ids.name(dest) << ": " << link_cost(best_interface)
+            << "(Cost " << id << best_interface->neighbor_id << ") + " << rib_in.row(best_row)[dest]
+            << "(" << best_interface->neighbor_id << " distance to " << ids.name(dest) << ") = " << distance
+            << ", was " << old_cost_str << "(Old " << id << " distance to " << ids.name(dest) + ")" << endl << endl;
+        }
+        else
+        {
+            mylog << "No neighbor reaches " << ids.name(dest) << ", was " << old_cost_str
+            << "(Old " << id << " distance to " << ids.name(dest) + ")" << endl << endl;
+        }
+        
+        if (dump)
+        {
+            mylog << "The routing table after change is:" << endl;
+            print_routetable();
+            
+            mylog << "*******************------------------------*******************" << endl;
+            mylog << endl << endl;
+        }
+        return true;
+    }
+    
+    // install a route and record the change in a new DV version
+    void set_route(uint32_t dest, int distance, uint32_t next_hop)
+    {
+        rib.distance[dest] = distance;
+        rib.next_hop[dest] = next_hop;
+        rib.dest_port[dest] = next_hop == NO_ID ? 0 : iface_of[next_hop]->port;
+        if (options.loop_free && dest != self && next_hop != NO_ID && distance < INF)
+            install_seqno(dest, seqno_via(row_of[next_hop], dest), distance);
+        counters.route_changes++;
+        log_change(dest);
+        host.routes_changed(dest);
+    }
+    
+    // record an advertised entry's change in a new DV version
+    void log_change(uint32_t dest)
+    {
+        if (options.delta && rib.changed_at[dest] != 0)
+            change_log.erase(rib.changed_at[dest]);
+        dv_version++;
+        rib.changed_at[dest] = dv_version;
+        if (options.delta) // only deltas read the log, and it would dominate a large simulation
+            change_log[dv_version] = dest;
+    }
+    
+    // advertise a route change: at once if no window is open, otherwise when it
+    // ends, so a burst of changes goes out as one update per neighbor
+    void trigger_update()
+    {
+        if (holding)
+            dirty = true;
+        else
+            send_triggered();
+    }
+    
+    void send_triggered()
+    {
+        counters.triggered_updates++;
+        broadcast_dv();
+        if (options.hold_ms <= 0) return;
+        // jitter keeps neighbors that changed together from advertising in lockstep
+        holding = true;
+        host.arm_hold_timer(options.hold_ms + uniform_int_distribution<int>(0, options.hold_ms / 4)(jitter_rng));
+    }
+    
+    // our whole distance vector: every destination with a route, plus ourselves
+    DVMsg full_dv()
+    {
+        DVMsg dvm(id, my_caps());
+        dvm.version = dv_version;
+        dvm.entries.reserve(rib.size());
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            if (dest == self || (rib.next_hop[dest] != NO_ID && !provisional(dest)))
+                dvm.entries.push_back(entry_for(dest, rib.distance[dest]));
+        }
+        return dvm;
+    }
+    
+    void send_control(uint8_t type, uint32_t version, shared_ptr<Interface> interface)
+    {
+        DVMsg msg(id, my_caps());
+        msg.type = type;
+        msg.version = version;
+        size_t len = msg.toBinary(shared.encode_buffer.data(), shared.encode_buffer.size(), ids);
+        send(shared.send_pool.copy(shared.encode_buffer.data(), len), interface->port);
+    }
+    
+    void send(const string& message, uint16_t port)
+    {
+        host.send(port, shared.send_pool.copy(message.data(), message.size()));
+    }
+    
+    void send(const SendBuffer& message, uint16_t port)
+    {
+        host.send(port, message);
+    }
+    
+    void log_dv_cause(const DVMsg& dvm, uint32_t dest, int distance)
+    {
+        mylog << "Change is caused by " << dvm.src_id << "'s DV: ";
+        mylog << "DV{ source id: " << dvm.src_id << ", " << flush;
+        mylog << "(destination, distance) pairs: " << flush;
+        
+        for (auto& entry : dvm.entries)
+        {
+            mylog << "(" << ids.name(entry.dest) << "," << entry.cost << ")";
+        }
+        
+        mylog << " }." << endl;
+        mylog << "More Specifically, it is due to the distance of " << dvm.src_id << " to "
+        << ids.name(dest) << " is " << distance << "." << endl;
+    }
+    
+    // a hello starts or refreshes the neighbor's session; from then on hellos,
+    // not DVs, keep its failure timer running. It does not bring a down link
+    // back up: that takes a DV carrying the neighbor's routes.
+    void handle_hello(const char* message, size_t len)
+    {
+        DVMsg::DVReader reader;
+        if (!reader.open(message, len)) return;
+        uint32_t src = ids.find(reader.src, reader.src_len);
+        if (src == NO_ID || iface_of.count(src) == 0) return; // not one of our neighbors
+        shared_ptr<Interface> interface = iface_of[src];
+        interface->hello_detect_ms = max((uint32_t) 1, reader.hello_interval) * max((uint8_t) 1, reader.hello_mult);
+        host.arm_fail_timer(interface, interface->hello_detect_ms);
+    }
+    
+    void handle_dv(const DVMsg& dvm)
+    {
+        sync_ids(); // decoding may have interned new destinations
+        
+        uint32_t src = ids.find(dvm.src_id);
+        if (src == NO_ID || iface_of.count(src) == 0) return; // not one of our neighbors
+        shared_ptr<Interface> interface = iface_of[src];
+        interface->peer_caps = dvm.caps;
+        
+        if (dvm.type == DVB_ACK)
+        {
+            // a version we never sent means the neighbor acked a previous run of ours
+            if (dvm.version <= dv_version)
+                interface->acked_version = max(interface->acked_version, dvm.version);
+            return;
+        }
+        if (dvm.type == DVB_RESYNC)
+        {
+            interface->acked_version = 0;
+            send_dv(interface);
+            return;
+        }
+        
+        // refresh neighbor's timer
+        //                neighbors[dvm.src_id]->fail_timer.cancel();
+        if (interface->hello_detect_ms == 0)
+            host.arm_fail_timer(interface, FAIL_SEC * 1000);
+        
+        bool is_delta = dvm.type == DVB_DELTA;
+        if (is_delta && dvm.base > interface->rx_version)
+        {
+            // we missed the state this delta builds on
+            send_control(DVB_RESYNC, 0, interface);
+            return;
+        }
+        
+        // store the neighbor's vector: a full DV replaces it, a delta patches it
+        int32_t* row = rib_in.row(interface->row);
+        if (!is_delta)
+        {
+            fill(row, row + rib_in.cols, (int32_t) INF);
+            row[src] = 0;
+        }
+        for (auto& entry : dvm.entries)
+        {
+            row[entry.dest] = entry.cost;
+        }
+        if (options.loop_free)
+        {
+            int32_t* seqnos = rib_seq.row(interface->row);
+            for (auto& entry : dvm.entries)
+                seqnos[entry.dest] = entry.seqno;
+        }
+        
+        bool has_change = false;
+        if (interface->provisional)
+        {
+            // its row is fresh now: the routes still through it are confirmed
+            // and advertised, even those the DV leaves unchanged
+            interface->provisional = false;
+            for (uint32_t dest = 0; dest < rib.size(); dest++)
+            {
+                if (rib.next_hop[dest] == src && dest != src && rib.distance[dest] < INF)
+                {
+                    log_change(dest);
+                    has_change = true;
+                }
+            }
+        }
+        if (!is_delta || interface->down)
+        {
+            // the whole vector (or the link itself) may have changed
+            interface->down = false;
+            has_change |= recompute_all(&dvm);
+        }
+        else
+        {
+            bool moved = false; // the neighbor's own distance to us changed
+            for (auto& entry : dvm.entries)
+            {
+                has_change |= recompute(entry.dest, &dvm);
+                moved |= entry.dest == self;
+            }
+            if (moved) find_alternates(); // the loop-free condition of every destination did too
+        }
+        
+        if (options.delta && (dvm.caps & CAP_DELTA))
+        {
+            interface->rx_version = dvm.version;
+            send_control(DVB_ACK, dvm.version, interface);
+        }
+        
+        // if any change, broadcast to neighbors (using broadcast())
+        
+        if (has_change)
+        {
+            //                    broadcast(dvmsg());
+            trigger_update();
+        }
+    }
+    
+    DVHost& host;
+    string id;  // router id
+    uint16_t local_port; // router listening port
+    map<string, shared_ptr<Interface> > neighbors; // Interfaces to neighbors
+    CoreOptions options;
+    DVShared& shared;
+    IdTable& ids; // router name <=> index, shared.ids
+    AsyncLog& mylog; // logging file
+    uint32_t self; // our own index
+    Rib rib; // Routing table, which doubles as our distance vector
+    map<uint32_t, shared_ptr<Interface> > iface_of; // neighbor's router index => Interface
+    vector<shared_ptr<Interface> > row_iface; // Adj-RIB-In row => Interface
+    vector<int32_t> row_of; // router index => Adj-RIB-In row, -1 if not a neighbor
+    vector<size_t> free_rows; // Adj-RIB-In rows of removed neighbors, for the next one added
+    DVMatrix rib_seq; // loop-free mode: sequence number of every Adj-RIB-In entry
+    vector<int32_t> requested; // loop-free mode: dest => seqno last requested or forwarded, -1 if none
+    DVMatrix rib_in; // Adj-RIB-In: every neighbor's last DV
+    MinPlusKernel minplus; // route recompute kernel picked for this CPU
+    const char* minplus_name;
+    vector<int32_t> row_cost, best, best_row; // recompute_all scratch
+    vector<uint32_t> changed; // destinations whose route the last recompute_all changed
+    DVMsg rx_dv; // last received DV, reused to avoid reallocating
+    uint32_t dv_version; // bumped on every change to an advertised entry
+    map<uint32_t, uint32_t> change_log; // version => destination changed in it (delta mode only)
+    uint32_t dv_rounds; // periodic advertisements sent
+    bool holding; // a hold-down window is open
+    bool dirty; // routes changed during the window and are not advertised yet
+    minstd_rand jitter_rng; // hold-down jitter, seeded from our id
+    SendBuffer hello; // our hello, the same bytes every time
+    CoreStats counters;
+};
+
+#endif
@@ -3,140 +3,160 @@
 #include <boost/bind.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <stdint.h>
 #include <ctime>
 #include <iomanip>
+#include <cstring>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <thread>
+#include <unistd.h>
 
-#define DV_SEND_SEC 5
-#define FAIL_SEC 10
-
-#define INF 100000
-
+#include "AsyncLog.h"
+#include "BatchUdp.h"
+#include "BufferPool.h"
+#include "DVCore.h"
+#include "Fib.h"
+#include "Metrics.h"
+#include "TimerWheel.h"
+#include "Topology.h"
 
 using namespace std;
 using namespace boost::asio::ip;
 
-boost::asio::io_service io_service;
-
-// Interface to neighbor node
-struct Interface {
-    Interface(uint16_t port, string neighbor_id, int cost)
-    : port(port), neighbor_id(neighbor_id), cost(cost),
-    fail_timer(io_service) {}
-    
-    uint16_t port;  // neighbor's port number
-    string neighbor_id; // neighbor's id
-    int cost;   // link cost to neighbor
-    boost::asio::deadline_timer fail_timer; // timer for detecting neighbor's failure (not receiving DV for a certain time
-};
+#define WHEEL_TICK_MS 100 // resolution of the neighbor liveness wheel, finer with hellos
+#define SNAPSHOT_SEC 30 // default interval between warm-start snapshots
 
-// Routing Table's Entry
-struct RTEntry {
-    RTEntry() {}
-    RTEntry(int distance, uint16_t outgoing_port, uint16_t dest_port, string next_hop)
-    : distance(distance), outgoing_port(outgoing_port), dest_port(dest_port), next_hop(next_hop) {}
-    
-    int distance;   // distance to a node
-    uint16_t outgoing_port; // outgoing port number
-    uint16_t dest_port; // next hop port number
-    string next_hop; // neighbor router id
-};
+// Lets the data-plane workers bind the router's port alongside the control socket
+typedef boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT> reuse_port;
 
-// Distance vector
-typedef map<string,int> DV;
+// Control plane: DV processing, cost changes, timers and stdin. Only the main
+// thread runs it, so it serializes every change to the routing table.
+boost::asio::io_service io_service;
 
-// Distance vector message
-struct DVMsg {
-    DVMsg(string src_id, map<string,int>  dv)
-    : src_id(src_id), dv(dv) {}
-    
-    string toString()
-    {
-        // encode object to string
-        string message = "";
-        message += src_id;
-        message += ":";
-        for(auto it = dv.begin(); it != dv.end(); ++it){
-            message += it->first;
-            message += ",";
-            message += to_string(it->second);
-            message += ";";
-        }
-        message += " ";
-        return message;
-    }
-    
-    static DVMsg fromString(string str)
-    {
-        // decode string to object
-        size_t i = str.find(":");
-        string id = str.substr(0,i);
-        str = str.substr(i+1);
-        map<string, int> m;
-        while(str.find(";") != string::npos){
-            i = str.find(",");
-            string d_id = str.substr(0,i);
-            str = str.substr(i+1);
-            i = str.find(";");
-            int c = stoi(str.substr(0,i));
-            m[d_id] = c;
-            str = str.substr(i+1);
-        }
-        return DVMsg(id, m);
-    }
-    
-    string src_id; // id of node that send the DV
-    DV dv;  // Distance vector
+// Command-line options
+struct RouterOptions : CoreOptions {
+    RouterOptions() : log_level(LOG_DEBUG), threads(0), batch(0), snapshot_sec(SNAPSHOT_SEC) {}
+    
+    LogLevel log_level; // LOG_INFO drops the routing-table dumps
+    unsigned threads; // data-plane worker threads; 0 forwards on the control plane
+    unsigned batch; // datagrams per recvmmsg/sendmmsg; 0 uses one async call per datagram
+    string metrics_socket; // Unix socket the metrics are served on, if any
+    string snapshot; // warm-start snapshot file, restored at startup and saved every snapshot_sec and on exit
+    int snapshot_sec;
+    string topology; // init.txt or an indexed topology; reloaded on "reload" or SIGHUP
 };
 
-vector<string> my_split(string str, int num_parts, string delimit)
+// our port and links from a topology file; false if it has no record of id
+bool read_topology(const string& topology, const string& id, uint16_t& local_port,
+                   map<string, shared_ptr<Interface> >& neighbors)
 {
-    vector<string> res;
-    size_t pos_pre = 0;
-    while (num_parts > 1)
+    local_port = 0;
+    neighbors.clear();
+    if (TopologyIndex::is_index(topology))
     {
-        size_t pos = str.find_first_of(delimit, pos_pre);
-        if (pos == string::npos) break;
-        
-        string sub = str.substr(pos_pre, pos - pos_pre);
-        boost::algorithm::trim(sub);
-        pos_pre = pos + 1;
-        if (sub.length() == 0) continue;
-        
-        res.push_back(sub);
-        num_parts--;
+        // indexed topology: jump straight to our own record and links
+        TopologyIndex index;
+        uint32_t self = TOPO_NO_ROUTER;
+        if (index.open(topology)) self = index.find(id);
+        if (self != TOPO_NO_ROUTER)
+        {
+            local_port = index.port(self);
+            for (const TopologyIndex::Link* link = index.links_begin(self); link != index.links_end(self); link++)
+            {
+                string dest_router = index.name(link->dest);
+                neighbors[dest_router] = shared_ptr<Interface>(new Interface(index.port(link->dest), dest_router, link->cost));
+            }
+        }
+    }
+    else
+    {
+        ifstream initfile(topology.c_str());
+        string line;
+        while (getline(initfile, line))
+        {
+            vector<string> tokens;
+            boost::split(tokens, line, boost::is_any_of(","));
+            if (tokens.size() < 4) continue;
+            string src_router = tokens[0];
+            string dest_router = tokens[1];
+            uint16_t port = atoi(tokens[2].c_str());
+            int cost = atoi(tokens[3].c_str());
+            
+            if (id.compare(src_router) == 0)
+            {
+                shared_ptr<Interface> interface(new Interface(port, dest_router, cost));
+                neighbors[dest_router] = interface;
+            }
+            
+            if (local_port == 0 && id.compare(dest_router) == 0)
+            {
+                local_port = port;
+            }
+        }
+    }
+    return local_port != 0;
+}
+
+// Traffic counters of one thread, the control plane's or a worker's
+struct PlaneMetrics {
+    void count_rx(const char* message, size_t len)
+    {
+        MsgKind kind = message_kind(message, len);
+        rx_datagrams[kind].add();
+        rx_bytes[kind].add(len);
     }
     
-    string sub = str.substr(pos_pre);
-    if (sub.length() > 0)
-        res.push_back(sub);
+    void count_tx(const char* message, size_t len)
+    {
+        MsgKind kind = message_kind(message, len);
+        tx_datagrams[kind].add();
+        tx_bytes[kind].add(len);
+    }
     
-    return res;
-}
+    Counter rx_datagrams[MSG_KINDS];
+    Counter rx_bytes[MSG_KINDS];
+    Counter tx_datagrams[MSG_KINDS];
+    Counter tx_bytes[MSG_KINDS];
+    Counter send_errors; // sends that completed with an error
+    Counter no_route; // data messages dropped for lack of a route
+};
 
-// Main router class
-class DVRouter
+// Main router class: hosts a DVCore on a UDP socket, asio timers and stdin
+class DVRouter : public DVHost
 {
-    const static int MAX_LENGTH = 8192;
+    // Data-plane worker: a thread running its own io_service with its own
+    // socket on our port
+    struct Worker {
+        Worker() : sock(service) {}
+        
+        boost::asio::io_service service;
+        udp::socket sock;
+        udp::endpoint remote_endpoint;
+        boost::array<char,MAX_DV_LENGTH> recv_buffer;
+        unique_ptr<BatchUdp> batch_io; // set in batched I/O mode
+        std::thread thread;
+        FibEpochs::Reader* fib_reader; // marks the Fib this worker is using
+        PlaneMetrics metrics; // written by this worker's thread only
+    };
 public:
-    DVRouter(string id, uint16_t local_port, map<string, shared_ptr<Interface> > neighbors)
-    : sock(io_service, udp::endpoint(udp::v4(), local_port)), id(id), local_port(local_port),
-    neighbors(neighbors), dv_timer(io_service), stdinput(io_service, STDIN_FILENO)
+    DVRouter(string id, uint16_t local_port, map<string, shared_ptr<Interface> > neighbors,
+             RouterOptions options)
+    : sock(io_service), id(id), local_port(local_port), options(options),
+    dv_timer(io_service), hold_timer(io_service), hello_timer(io_service), wheel_timer(io_service), snapshot_timer(io_service), reload_signal(io_service, SIGHUP),
+    wheel_start(std::chrono::steady_clock::now()), wheel_tick_ms(WHEEL_TICK_MS), stdinput(io_service, STDIN_FILENO), fib_pending(false), fib_rebuild(true)
     {
-        mylog.open("log." + id + ".txt", ofstream::out);
+        mylog.open("log." + id + ".txt");
+        mylog.set_level(options.log_level);
+        open_socket(sock);
         
-        // initialize its own distance vector and routing table (only know neighbors' info)
-        for (auto& i : neighbors)
-        {
-            string id = i.first;
-            shared_ptr<Interface> interface = i.second;
-            dv[id] = interface->cost;
-            RouteTable[id] = RTEntry(interface->cost, local_port, interface->port, interface->neighbor_id);
-        }
-        dv[id] = 0; // dv to itself is zero
+        core.reset(new DVCore(*this, id, local_port, neighbors, options, shared, mylog));
+        publish_fib();
         
         // periodically advertise its distance vector to each of its neighbors every DV_SEND_SEC seconds.
         
@@ -146,167 +166,342 @@ public:
         // Start an asynchronous wait.
         dv_timer.async_wait(boost::bind(&DVRouter::dv_timeout_handler, this));
         
+        // one tick timer finds every neighbor that went quiet; hellos need a
+        // tick well below their interval to detect within a few of them
+        if (options.hello_ms > 0)
+        {
+            wheel_tick_ms = max(1, min(WHEEL_TICK_MS, options.hello_ms / 4));
+            hello_rng.seed(local_port);
+            hello_timeout_handler();
+        }
+        start_wheel_timer();
+        
+        // install the routes we had before a restart instead of learning them again
+        if (!options.snapshot.empty())
+        {
+            RouteSnapshot snap;
+            if (snap.open(options.snapshot))
+                core->restore(snap);
+            if (options.snapshot_sec > 0)
+                start_snapshot_timer();
+        }
+        
         // receive from neighbors
-        start_receive();
+        if (options.batch > 0)
+        {
+            batch_io.reset(new BatchUdp(sock, options.batch, MAX_DV_LENGTH));
+            batch_io->start([this](const char* data, size_t len, const udp::endpoint&) {
+                metrics.count_rx(data, len);
+                handle_message(data, len);
+            });
+            logtime();
+            mylog << "Using batched UDP I/O, up to " << options.batch << " datagrams per call." << endl << endl;
+        }
+        else
+        {
+            start_receive();
+        }
         
         // input from stdin
         start_input();
+        start_reload_signal();
+        
+        if (!options.metrics_socket.empty())
+            start_metrics_socket();
+        
+        if (options.threads > 0)
+        {
+            for (unsigned i = 0; i < options.threads; i++)
+            {
+                workers.push_back(unique_ptr<Worker>(new Worker()));
+                Worker* worker = workers.back().get();
+                worker->fib_reader = fib.add_reader();
+                open_socket(worker->sock);
+                if (options.batch > 0)
+                {
+                    worker->batch_io.reset(new BatchUdp(worker->sock, options.batch, MAX_DV_LENGTH));
+                    worker->batch_io->start([this, worker](const char* data, size_t len, const udp::endpoint&)
+                                            { handle_worker_message(*worker, data, len); });
+                }
+                else
+                {
+                    start_worker_receive(worker);
+                }
+                worker->thread = std::thread([worker]() { worker->service.run(); });
+            }
+            logtime();
+            mylog << "Forwarding data on " << options.threads << " worker threads." << endl << endl;
+        }
     }
     
     ~DVRouter()
     {
+        // workers log, so they have to stop before the log does
+        for (auto& worker : workers) worker->service.stop();
+        for (auto& worker : workers) worker->thread.join();
+        if (metrics_acceptor) unlink(options.metrics_socket.c_str());
+        if (!options.snapshot.empty()) save_snapshot();
         mylog.close();
     }
     
-    void broadcast_dv()
+    // dest_id may carry a flow label, "B/video", that picks among equal-cost paths
+    void send_data(string message, string dest_id, bool is_src)
     {
-        for (auto& i : neighbors)
+        string flow;
+        size_t slash = dest_id.find('/');
+        if (slash != string::npos)
         {
-            string neighbor_id = i.first;
-            send_dv(neighbor_id);
-            //            shared_ptr<Interface> interface = i.second;
-            //            send(message, udp::endpoint(udp::v4(), interface->port));
+            flow = dest_id.substr(slash + 1);
+            dest_id.resize(slash);
         }
+        
+        string data = is_src ? "data:" + dest_id + ":" + id + (flow.empty() ? "" : "/" + flow) + ":" + message : message;
+        DataHeader header;
+        header.parse(data.data(), data.size());
+        uint16_t port;
+        uint32_t next_hop;
+        if (!fib.get()->lookup(fib_key(dest_id.data(), dest_id.size()), header.flow_hash(), port, next_hop))
+        {
+            metrics.no_route.add();
+            return;
+        }
+        
+        if (is_src) // is source
+        {
+            logtime();
+            mylog << id << " send message from " << id << " to " << dest_id << endl << endl;
+        }
+        send(data, udp::endpoint(udp::v4(), port));
     }
     
-    void send_dv(string neighbor_id)
+    // DVHost
+    void send(uint16_t port, const SendBuffer& message)
     {
-        DV new_dv(dv);
-        
-        for (auto& it : RouteTable)
+        send(message, udp::endpoint(udp::v4(), port));
+    }
+    
+    // called for every DV or hello received, so it only records the new deadline
+    void arm_fail_timer(shared_ptr<Interface> interface, int ms)
+    {
+        if (fail_iface.size() <= interface->row) fail_iface.resize(interface->row + 1);
+        fail_iface[interface->row] = interface;
+        liveness.refresh((uint32_t) interface->row, (ms + wheel_tick_ms - 1) / wheel_tick_ms);
+    }
+    
+    void cancel_fail_timer(shared_ptr<Interface> interface)
+    {
+        liveness.cancel((uint32_t) interface->row);
+    }
+    
+    void arm_hold_timer(int ms)
+    {
+        hold_timer.expires_from_now(boost::posix_time::milliseconds(ms));
+        hold_timer.async_wait(boost::bind(&DVRouter::hold_timeout_handler, this, boost::asio::placeholders::error));
+    }
+    
+    void routes_changed(uint32_t dest)
+    {
+        // patch the Fib once for all the changes made by the current handler
+        fib_dirty.push_back(dest);
+        if (!fib_pending)
         {
-            string dest_id = it.first;
-            shared_ptr<Interface> interface = neighbors[neighbor_id];
-            if (neighbor_id.compare(it.second.next_hop) == 0)
-            {
-                new_dv[dest_id] = INF;
-            }
-            string message = "dv:" + DVMsg(id, new_dv).toString();
-            send(message, udp::endpoint(udp::v4(), interface->port));
+            fib_pending = true;
+            io_service.post(boost::bind(&DVRouter::publish_fib, this));
         }
     }
     
-    void change_cost(string neighbor_id, int new_cost, bool reciprocal, bool temp)
+private:
+    // bring the Fib up to date with the routing table: changed entries are
+    // patched in place, and a new table is only built and swapped in when
+    // the old one is full
+    void publish_fib()
     {
-        if (neighbors[neighbor_id]->cost != new_cost)
+        fib_pending = false;
+        const Rib& rib = core->routes();
+        Fib* current = fib.get();
+        if (!fib_rebuild && current)
         {
-            logtime();
-            mylog << "Cost " << id << neighbor_id << " changed from "
-            << neighbors[neighbor_id]->cost << " to " << new_cost << endl << endl;
-            
-            if (!temp) neighbors[neighbor_id]->cost = new_cost;
-            RouteTable[neighbor_id].distance = new_cost;
-            dv[neighbor_id] = new_cost;
-            int neighbor_cost = new_cost;
-            
-            for (auto& it : RouteTable)
+            if (rib.max_paths > 1)
             {
-                string dest_id = it.first;
-                int distance = dv[dest_id];
-                if (it.second.next_hop.compare(neighbor_id) == 0 && min(distance + neighbor_cost, INF) > dv[dest_id])
-                {
-                    mylog << "******************* ";
-                    logtime();
-                    mylog << " *******************" << endl;
-                    
-                    mylog << "The routing table before change is:" << endl;
-                    print_routetable();
-                    mylog << endl;
-                    
-                    // update the DV and RouteTable
-                    
-                    string old_cost_str = "Inf";
-                    if (dv.count(dest_id) > 0 && dv[dest_id] < INF)
-                        old_cost_str = to_string(dv[dest_id]);
-                    
-                    dv[dest_id] = min(distance + neighbor_cost, INF);
-                    RouteTable[dest_id] = RTEntry(dv[dest_id], local_port, neighbors[neighbor_id]->port, neighbor_id);
-                    
-                    mylog << "The routing table after change is:" << endl;
-                    print_routetable();
-                    
-                    mylog << "*******************------------------------*******************" << endl;
-                    mylog << endl << endl;
-                }
+                // equal-cost sets change without a route change: compare them all
+                fib_dirty.clear();
+                for (uint32_t dest = 0; dest < rib.size(); dest++) fib_dirty.push_back(dest);
             }
-            
-            //            broadcast(dvmsg());
-            broadcast_dv();
-            
-            if (reciprocal)
+            for (uint32_t dest : fib_dirty)
             {
-                send("cost:" + neighbor_id + ":" + id + ":" + to_string(new_cost), udp::endpoint(udp::v4(), neighbors[neighbor_id]->port));
+                if (dest != NO_ID && !fib_set(*current, dest))
+                {
+                    fib_rebuild = true;
+                    break;
+                }
             }
         }
-        else
+        fib_dirty.clear();
+        if (!fib_rebuild && current) return;
+        
+        fib_rebuild = false;
+        Fib* next = new Fib(max(rib.size(), current ? 2 * current->size() : 0), rib.max_paths);
+        for (auto& i : core->interfaces())
         {
-            logtime();
-            mylog << "Cost is not changed." << endl << endl;
+            if (next->hop_names.size() <= i.second->idx) next->hop_names.resize(i.second->idx + 1);
+            next->hop_names[i.second->idx] = i.first;
         }
+        for (uint32_t dest = 0; dest < rib.size(); dest++)
+        {
+            if (core->has_route(dest)) fib_set(*next, dest);
+        }
+        fib.replace(next);
     }
     
-    void send_data(string message, string dest_id, bool is_src)
+    bool fib_set(Fib& table, uint32_t dest)
     {
-        if (RouteTable.count(dest_id) > 0 && is_src) // is source
-        {
-            logtime();
-            mylog << id << " send message from " << id << " to " << dest_id << endl << endl;
-            send("data:" + dest_id + ":" + id + ":" + message, udp::endpoint(udp::v4(), RouteTable[dest_id].dest_port));
-        }
-        else if(RouteTable.count(dest_id) > 0 && !is_src)
-        {
-            send(message, udp::endpoint(udp::v4(), RouteTable[dest_id].dest_port));
-        }
+        const Rib& rib = core->routes();
+        if (dest == core->self_index()) return true;
+        const string& name = core->names().name(dest);
+        if (!core->has_route(dest)) return table.set(fib_key(name.data(), name.size()), 0, 0, NULL, NULL, 0);
+        size_t path_count = rib.max_paths > 1 ? rib.path_count[dest] : 0;
+        return table.set(fib_key(name.data(), name.size()), rib.dest_port[dest], rib.next_hop[dest],
+                         path_count ? &rib.path_port[dest * rib.max_paths] : NULL,
+                         path_count ? &rib.paths[dest * rib.max_paths] : NULL, path_count);
     }
     
-private:
-    //    string dvmsg()
-    //    {
-    //
-    //        return "dv:" + DVMsg(id, dv).toString();
-    //    }
+    // bind a socket to our port; with workers every socket shares it and the
+    // kernel spreads incoming datagrams across them
+    void open_socket(udp::socket& s)
+    {
+        s.open(udp::v4());
+        if (options.threads > 0) s.set_option(reuse_port(true));
+        s.bind(udp::endpoint(udp::v4(), local_port));
+    }
+    
+    void send(const string& message, udp::endpoint sendee_endpoint)
+    {
+        send(shared.send_pool.copy(message.data(), message.size()), sendee_endpoint);
+    }
     
-    void send(string message, udp::endpoint sendee_endpoint)
+    // the completion handler holds a reference to buffer until the send is done
+    void send(const SendBuffer& buffer, udp::endpoint sendee_endpoint)
     {
-        sock.async_send_to(boost::asio::buffer(message), sendee_endpoint,
+        metrics.count_tx(buffer.data(), buffer.size());
+        if (batch_io)
+        {
+            batch_io->send(buffer.data(), buffer.size(), sendee_endpoint);
+            return;
+        }
+        sock.async_send_to(boost::asio::buffer(buffer.data(), buffer.size()), sendee_endpoint,
                            boost::bind(&DVRouter::handle_send, this,
                                        boost::asio::placeholders::error,
-                                       boost::asio::placeholders::bytes_transferred));
+                                       boost::asio::placeholders::bytes_transferred, buffer));
     }
     
     void dv_timeout_handler()
     {
-        //        broadcast(dvmsg());
-        broadcast_dv();
+        core->on_dv_timer();
         dv_timer.expires_from_now(boost::posix_time::seconds(DV_SEND_SEC));
         dv_timer.async_wait(boost::bind(&DVRouter::dv_timeout_handler, this));
     }
     
-    void fail_timeout_handler(string src_id, const boost::system::error_code& error)
+    void hold_timeout_handler(const boost::system::error_code& error)
     {
         if (error == boost::asio::error::operation_aborted) {
             return;
         }
-        
-        logtime();
-        mylog << "Have not received DV from " << src_id << " for " << FAIL_SEC << " seconds. " << flush;
-        mylog << "Mark DV to " << src_id << " as Inf." << endl << endl;
-        
-        mylog << "******************* ";
+        core->on_hold_timer();
+    }
+    
+    void hello_timeout_handler()
+    {
+        core->on_hello_timer();
+        // like BFD, each interval is shortened by up to a quarter so neighbors do not synchronize
+        int ms = options.hello_ms - uniform_int_distribution<int>(0, options.hello_ms / 4)(hello_rng);
+        hello_timer.expires_from_now(boost::posix_time::milliseconds(ms));
+        hello_timer.async_wait(boost::bind(&DVRouter::hello_timeout_handler, this));
+    }
+    
+    void start_wheel_timer()
+    {
+        wheel_timer.expires_from_now(boost::posix_time::milliseconds(wheel_tick_ms));
+        wheel_timer.async_wait(boost::bind(&DVRouter::wheel_timeout_handler, this));
+    }
+    
+    void wheel_timeout_handler()
+    {
+        // how late the timer fires is how long other handlers held the event loop
+        boost::posix_time::time_duration late = boost::asio::deadline_timer::traits_type::now() - wheel_timer.expires_at();
+        loop_lag.observe_us(late.is_negative() ? 0 : late.total_microseconds());
+
+        // the tick follows the clock, so a late timer catches up instead of drifting
+        uint64_t tick = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - wheel_start).count() / wheel_tick_ms;
+        liveness.advance(tick, [this](const vector<uint32_t>& rows) {
+            for (uint32_t row : rows) core->neighbor_timeout(fail_iface[row]);
+        });
+        fib.reclaim();
+        start_wheel_timer();
+    }
+    
+    void start_reload_signal()
+    {
+        reload_signal.async_wait([this](const boost::system::error_code& error, int) {
+            if (error == boost::asio::error::operation_aborted) return;
+            reload_topology();
+            start_reload_signal();
+        });
+    }
+    
+    // apply the neighbors of a changed topology file without restarting
+    void reload_topology()
+    {
+        uint16_t port;
+        map<string, shared_ptr<Interface> > wanted;
+        if (!read_topology(options.topology, id, port, wanted))
+        {
+            mylog.at(LOG_ERROR);
+            logtime();
+            mylog << "Cannot reload " << options.topology << ": no record of " << id << endl << endl;
+            return;
+        }
         logtime();
-        mylog << " *******************" << endl;
-        
-        mylog << "The routing table before change is:" << endl;
-        print_routetable();
-        mylog << endl;
-        
-        change_cost(src_id, INF, false, true);
-        
-        mylog << "The routing table after change is:" << endl;
-        print_routetable();
-        
-        mylog << "*******************------------------------*******************" << endl;
-        mylog << endl << endl;
+        mylog << "Reloading " << options.topology << endl << endl;
+        if (port != local_port)
+        {
+            mylog.at(LOG_ERROR);
+            logtime();
+            mylog << "Our own port changed from " << local_port << " to " << port << "; that takes a restart." << endl << endl;
+        }
+        core->reconfigure(wanted);
+        neighbors_changed();
+    }
+    
+    // the Fib names next hops by neighbor, so a new set needs a new Fib
+    void neighbors_changed()
+    {
+        fib_rebuild = true;
+        routes_changed(NO_ID);
+    }
+    
+    void start_snapshot_timer()
+    {
+        snapshot_timer.expires_from_now(boost::posix_time::seconds(options.snapshot_sec));
+        snapshot_timer.async_wait(boost::bind(&DVRouter::snapshot_timeout_handler, this));
+    }
+    
+    void snapshot_timeout_handler()
+    {
+        save_snapshot();
+        start_snapshot_timer();
+    }
+    
+    void save_snapshot()
+    {
+        RouteSnapshot::Builder snap;
+        core->snapshot(snap);
+        if (!snap.write(options.snapshot))
+        {
+            mylog.at(LOG_ERROR);
+            logtime();
+            mylog << "Cannot write the snapshot " << options.snapshot << endl << endl;
+        }
     }
     
     void start_input()
@@ -332,20 +527,52 @@ private:
             mylog << "Your command: " << str << endl << endl;
             
             vector<string> tokens = my_split(str, 3, ":");
+            tokens.resize(3);
             string tag = tokens[0];
             string dest_id = tokens[1];
             string message = tokens[2];
             
             if (tag.compare("cost") == 0) // change neighbor cost, e.g. "cost:B:100"
             {
-                change_cost(dest_id, stoi(message), true, false);
+                core->change_cost(dest_id, atoi(message.c_str()), true, false);
             }
-            else if (tag.compare("data") == 0) // send data, e.g. "data:B:hello"
+            else if (tag.compare("data") == 0) // send data, e.g. "data:B:hello" or "data:B/flow1:hello"
             {
                 send_data(message, dest_id, true);
             }
+            else if (tag.compare("stats") == 0) // print the metrics
+            {
+                cout << render_metrics() << flush;
+            }
+            else if (tag.compare("link") == 0) // add or update a neighbor, e.g. "link:G:10006:4"
+            {
+                vector<string> link = my_split(message, 2, ":");
+                link.resize(2);
+                int port = atoi(link[0].c_str());
+                if (port <= 0 || port > 0xFFFF || link[1].empty())
+                {
+                    mylog.at(LOG_ERROR);
+                    logtime();
+                    mylog << "Invalid link: " << str << endl << endl;
+                }
+                else
+                {
+                    core->add_neighbor(dest_id, (uint16_t) port, atoi(link[1].c_str()));
+                    neighbors_changed();
+                }
+            }
+            else if (tag.compare("unlink") == 0) // remove a neighbor, e.g. "unlink:G"
+            {
+                core->remove_neighbor(dest_id);
+                neighbors_changed();
+            }
+            else if (tag.compare("reload") == 0) // re-read the topology file
+            {
+                reload_topology();
+            }
             else
             {
+                mylog.at(LOG_ERROR);
                 logtime();
                 mylog << "Invalid command: " << str << endl << endl;
             }
@@ -361,266 +588,377 @@ private:
     
     void start_receive()
     {
-        sock.async_receive_from(boost::asio::buffer(recv_buffer), remote_endpoint,
+        // receive straight into a send slab so a relayed data message can go out as is;
+        // the last one is reused unless a pending send still holds it
+        if (!rx_slab.unique()) rx_slab = shared.send_pool.get();
+        sock.async_receive_from(boost::asio::buffer(rx_slab.data(), rx_slab.capacity()), remote_endpoint,
                                 boost::bind(&DVRouter::handle_receive, this,
                                             boost::asio::placeholders::error,
                                             boost::asio::placeholders::bytes_transferred));
     }
     
-    void print_routetable()
+    void logtime()
+    {
+        mylog << " [" << mylog.timestamp() << "] ";
+    }
+    
+    void handle_receive(const boost::system::error_code& error, size_t bytes_recvd)
     {
-        mylog << "Destination\tDistance\tOutgoing UDP port\tDestination UDP port" << endl;
-        for (auto &it : RouteTable)
+        if (!error || error == boost::asio::error::message_size)
         {
-            string cost_str = "Inf";
-            if (it.second.distance < INF)
-                cost_str = to_string(it.second.distance);
-            mylog << it.first << "\t\t" << cost_str << "\t\t" << it.second.outgoing_port
-            << "(Node "+ id + ")" << "\t\t" << it.second.dest_port << "(Node " + it.second.next_hop + ")" << endl;
+            rx_slab.resize(bytes_recvd);
+            metrics.count_rx(rx_slab.data(), bytes_recvd);
+            handle_message(rx_slab.data(), bytes_recvd, &rx_slab);
         }
+        
+        // continue listening
+        start_receive();
     }
     
-    void logtime()
+    // a message a worker received but does not handle itself
+    void handle_posted(const string& message)
     {
-        time_t rawtime;
-        struct tm * timeinfo;
-        time( &rawtime );
-        timeinfo = localtime( &rawtime );
-        char * time = asctime(timeinfo);
-        time[strlen(time)-1] = '\0';
-        mylog << " [" << time << "] " << flush;
+        handle_message(message.data(), message.size());
     }
     
-    void handle_receive(const boost::system::error_code& error, size_t bytes_recvd)
+    // original is the slab holding message, if it is in one
+    void handle_message(const char* message, size_t len, const SendBuffer* original = NULL)
     {
-        if (!error || error == boost::asio::error::message_size)
+        DataHeader data;
+        if (data.parse(message, len)) // data message
         {
-            string recv_str(recv_buffer.begin(), recv_buffer.begin() + bytes_recvd);
-            vector<string> tokens = my_split(recv_str, 2, ":");
-            
-            string tag = tokens[0];
-            
-            if (tag.compare("data") == 0) // data message
-            {
-                tokens = my_split(tokens[1], 3, ":");
-                string dest_id = tokens[0];
-                string src_id = tokens[1];
-                string data = tokens[2];
-                
-                if (dest_id.compare(id) == 0) // I'm destination
-                {
-                    logtime();
-                    mylog << id << " received data message from " << src_id << ": " << data << endl << endl;
-                }
-                else
-                {
-                    logtime();
-                    mylog << id << " relay data (src: " << src_id << ", dest: " << dest_id << ") to port "
-                    << RouteTable[dest_id].dest_port << "(Node " << RouteTable[dest_id].next_hop << "): "
-                    << data << endl << endl;
-                    send_data(recv_str, dest_id, false);
-                }
-            }
-            else if (tag.compare("cost") == 0)
-            {
-                tokens = my_split(tokens[1], 3, ":");
-                string dest_id = tokens[0];
-                string src_id = tokens[1];
-                int cost = stoi(tokens[2]);
-                
-                if (dest_id.compare(id) == 0) // I am the destination
-                {
-                    logtime();
-                    mylog << id << " received cost change from " << src_id << endl << endl;
-                    change_cost(src_id, cost, false, false);
-                }
-            }
-            else if (tag.compare("dv") == 0)  // dv message
+            relay_data(data, message, len, original);
+            return;
+        }
+        if (message_kind(message, len) != MSG_DV)
+        {
+            core->handle_control(message, len);
+            return;
+        }
+        // DVs are what the control plane spends its time on: time parsing and applying them
+        auto start = std::chrono::steady_clock::now();
+        core->handle_control(message, len);
+        dv_latency.observe_us(std::chrono::duration_cast<std::chrono::microseconds>(
+                                  std::chrono::steady_clock::now() - start).count());
+    }
+    
+    bool for_me(const DataHeader& data)
+    {
+        return data.dest_len == id.size() && memcmp(data.dest, id.data(), id.size()) == 0;
+    }
+    
+    void log_data_received(const DataHeader& data)
+    {
+        logtime();
+        mylog << id << " received data message from ";
+        mylog.write(data.src, data.src_len) << ": ";
+        mylog.write(data.payload, data.payload_len) << endl << endl;
+    }
+    
+    void log_data_relayed(const DataHeader& data, uint16_t port, const string& next_hop)
+    {
+        logtime();
+        mylog << id << " relay data (src: ";
+        mylog.write(data.src, data.src_len) << ", dest: ";
+        mylog.write(data.dest, data.dest_len) << ") to port " << port << "(Node " << next_hop << "): ";
+        mylog.write(data.payload, data.payload_len) << endl << endl;
+    }
+    
+    // forward a data message unchanged; the slab it arrived in is sent as is
+    void relay_data(const DataHeader& data, const char* message, size_t len, const SendBuffer* original)
+    {
+        if (for_me(data))
+        {
+            log_data_received(data);
+            return;
+        }
+        
+        // the control plane writes the Fib, so it reads it without an epoch
+        const Fib* current = fib.get();
+        uint16_t port;
+        uint32_t hop;
+        if (!current->lookup(fib_key(data.dest, data.dest_len), data.flow_hash(), port, hop))
+        {
+            metrics.no_route.add();
+            return;
+        }
+        log_data_relayed(data, port, current->hop_names[hop]);
+        
+        udp::endpoint next_hop(udp::v4(), port);
+        if (original)
+            send(*original, next_hop);
+        else
+            send(shared.send_pool.copy(message, len), next_hop);
+    }
+    
+    // every metric in the Prometheus text format; the workers' counters are
+    // added to the control plane's
+    string render_metrics()
+    {
+        vector<const PlaneMetrics*> planes(1, &metrics);
+        for (auto& worker : workers) planes.push_back(&worker->metrics);
+        
+        MetricsWriter w;
+        per_kind(w, planes, "dvrouter_rx_datagrams_total", "Datagrams received, by message type.", &PlaneMetrics::rx_datagrams);
+        per_kind(w, planes, "dvrouter_rx_bytes_total", "Bytes received, by message type.", &PlaneMetrics::rx_bytes);
+        per_kind(w, planes, "dvrouter_tx_datagrams_total", "Datagrams sent, by message type.", &PlaneMetrics::tx_datagrams);
+        per_kind(w, planes, "dvrouter_tx_bytes_total", "Bytes sent, by message type.", &PlaneMetrics::tx_bytes);
+        
+        uint64_t send_errors = batch_io ? batch_io->send_errors() : 0, no_route = 0;
+        for (auto& worker : workers)
+            if (worker->batch_io) send_errors += worker->batch_io->send_errors();
+        for (const PlaneMetrics* plane : planes)
+        {
+            send_errors += plane->send_errors.get();
+            no_route += plane->no_route.get();
+        }
+        w.counter("dvrouter_send_errors_total", "Datagrams the socket failed to send.", send_errors);
+        w.counter("dvrouter_data_no_route_total", "Data messages dropped for lack of a route.", no_route);
+        
+        const CoreStats& stats = core->stats();
+        w.family("dvrouter_updates_total", "counter", "Distance vector broadcasts, by cause.");
+        w.sample("dvrouter_updates_total", "cause=\"triggered\"", stats.triggered_updates);
+        w.sample("dvrouter_updates_total", "cause=\"periodic\"", stats.periodic_updates);
+        w.counter("dvrouter_route_changes_total", "Routing table entries installed.", stats.route_changes);
+        w.counter("dvrouter_fast_reroutes_total", "Routes moved to a loop-free alternate on a neighbor failure.", stats.fast_reroutes);
+        w.counter("dvrouter_seqno_requests_total", "Sequence number requests sent or forwarded (--loop-free).", stats.seqno_requests);
+        
+        size_t routes = 0;
+        for (uint32_t dest = 0; dest < core->routes().size(); dest++)
+            if (dest != core->self_index() && core->has_route(dest) && core->routes().distance[dest] < INF) routes++;
+        w.gauge("dvrouter_routes", "Destinations with a route.", routes);
+        w.gauge("dvrouter_table_bytes", "Memory held by the routing tables.", core->table_bytes());
+        
+        w.histogram("dvrouter_dv_process_seconds", "Time to parse and apply a received distance vector.", dv_latency);
+        w.histogram("dvrouter_event_loop_lag_seconds", "How late the control plane's periodic timer fires.", loop_lag);
+        return w.out;
+    }
+    
+    void per_kind(MetricsWriter& w, const vector<const PlaneMetrics*>& planes, const char* name, const char* help,
+                  Counter (PlaneMetrics::*field)[MSG_KINDS])
+    {
+        w.family(name, "counter", help);
+        for (int kind = 0; kind < MSG_KINDS; kind++)
+        {
+            uint64_t total = 0;
+            for (const PlaneMetrics* plane : planes) total += (plane->*field)[kind].get();
+            w.sample(name, string("type=\"") + msg_kind_names[kind] + "\"", total);
+        }
+    }
+    
+    // each connection to the metrics socket gets one dump and is closed
+    void start_metrics_socket()
+    {
+        typedef boost::asio::local::stream_protocol local;
+        unlink(options.metrics_socket.c_str());
+        metrics_acceptor.reset(new local::acceptor(io_service, local::endpoint(options.metrics_socket)));
+        accept_metrics();
+    }
+    
+    void accept_metrics()
+    {
+        typedef boost::asio::local::stream_protocol local;
+        shared_ptr<local::socket> client(new local::socket(io_service));
+        metrics_acceptor->async_accept(*client, [this, client](const boost::system::error_code& error) {
+            if (error == boost::asio::error::operation_aborted) return;
+            if (!error)
             {
-                DVMsg dvm = DVMsg::fromString(tokens[1]);
-                
-                int neighbor_cost = neighbors[dvm.src_id]->cost;
-                
-                // refresh neighbor's timer
-                //                neighbors[dvm.src_id]->fail_timer.cancel();
-                neighbors[dvm.src_id]->fail_timer.expires_from_now(boost::posix_time::seconds(FAIL_SEC));
-                neighbors[dvm.src_id]->fail_timer.async_wait(boost::bind(&DVRouter::fail_timeout_handler, this, dvm.src_id,
-                                                                         boost::asio::placeholders::error));
-                
-                bool has_change = false;
-                
-                for (auto& it : dvm.dv)
-                {
-                    string dest_id = it.first;
-                    int distance = it.second;
-                    
-                    if ((dv.count(dest_id) > 0 && (min(distance + neighbor_cost, INF) < dv[dest_id] ||
-                                                   (min(distance + neighbor_cost, INF) == dv[dest_id] && dvm.src_id.compare(RouteTable[dest_id].next_hop) < 0))) || dv.count(dest_id) == 0)
-                    {
-                        mylog << "******************* ";
-                        logtime();
-                        mylog << " *******************" << endl;
-                        
-                        mylog << "The routing table before change is:" << endl;
-                        print_routetable();
-                        mylog << endl;
-                        
-                        mylog << "Change is caused by " << dvm.src_id << "'s DV: ";
-                        mylog << "DV{ source id: " << dvm.src_id << ", " << flush;
-                        mylog << "(destination, distance) pairs: " << flush;
-                        
-                        for (auto &it : dvm.dv)
-                        {
-                            mylog << "(" << it.first << "," << it.second << ")";
-                        }
-                        
-                        mylog << " }." << endl;
-                        mylog << "More Specifically, it is due to the distance of " << dvm.src_id << " to "
-                        << dest_id << " is " << distance << "." << endl;
-                        
-                        // update the DV and RouteTable
-                        
-                        string old_cost_str = "Inf";
-                        if (dv.count(dest_id) > 0 && dv[dest_id] < INF)
-                            old_cost_str = to_string(dv[dest_id]);
-                        
-                        dv[dest_id] = min(distance + neighbor_cost, INF);
-                        RouteTable[dest_id] = RTEntry(dv[dest_id], local_port, neighbors[dvm.src_id]->port, dvm.src_id);
-                        has_change = true;
-                        
-                        mylog << "Update " << id << " distance to " << dest_id << ": " << neighbor_cost << "(Cost " << id << dvm.src_id << ") + "
-                        << distance << "(" << dvm.src_id << " distance to " << dest_id << ") = " << dv[dest_id] << " < " << old_cost_str
-                        << "(Old " << id << " distance to " << dest_id + ")" << endl << endl;
-                        
-                        mylog << "The routing table after change is:" << endl;
-                        print_routetable();
-                        
-                        mylog << "*******************------------------------*******************" << endl;
-                        mylog << endl << endl;
-                    }
-                }
-                
-                for (auto& it : RouteTable)
-                {
-                    string dest_id = it.first;
-                    int distance = dvm.dv[dest_id];
-                    if (it.second.next_hop.compare(dvm.src_id) == 0 && min(distance + neighbor_cost, INF) > dv[dest_id])
-                    {
-                        mylog << "******************* ";
-                        logtime();
-                        mylog << " *******************" << endl;
-                        
-                        mylog << "The routing table before change is:" << endl;
-                        print_routetable();
-                        mylog << endl;
-                        
-                        mylog << "Change is caused by " << dvm.src_id << "'s DV: ";
-                        mylog << "DV{ source id: " << dvm.src_id << ", " << flush;
-                        mylog << "(destination, distance) pairs: " << flush;
-                        
-                        for (auto &it : dvm.dv)
-                        {
-                            mylog << "(" << it.first << "," << it.second << ")";
-                        }
-                        
-                        mylog << " }." << endl;
-                        mylog << "More Specifically, it is due to the distance of " << dvm.src_id << " to "
-                        << dest_id << " is " << distance << "." << endl;
-                        
-                        // update the DV and RouteTable
-                        
-                        string old_cost_str = "Inf";
-                        if (dv.count(dest_id) > 0 && dv[dest_id] < INF)
-                            old_cost_str = to_string(dv[dest_id]);
-                        
-                        dv[dest_id] = min(distance + neighbor_cost, INF);
-                        RouteTable[dest_id] = RTEntry(dv[dest_id], local_port, neighbors[dvm.src_id]->port, dvm.src_id);
-                        has_change = true;
-                        
-                        mylog << "Update " << id << " distance to " << dest_id << ": " << neighbor_cost << "(Cost " << id << dvm.src_id << ") + "
-                        << distance << "(" << dvm.src_id << " distance to " << dest_id << ") = " << dv[dest_id] << " < " << old_cost_str
-                        << "(Old " << id << " distance to " << dest_id + ")" << endl << endl;
-                        
-                        mylog << "The routing table after change is:" << endl;
-                        print_routetable();
-                        
-                        mylog << "*******************------------------------*******************" << endl;
-                        mylog << endl << endl;
-                    }
-                }
-                
-                // if any change, broadcast to neighbors (using broadcast())
-                
-                if (has_change)
-                {
-                    //                    broadcast(dvmsg());
-                    broadcast_dv();
-                }
+                shared_ptr<string> text(new string(render_metrics()));
+                boost::asio::async_write(*client, boost::asio::buffer(*text),
+                                         [client, text](const boost::system::error_code&, size_t) {});
             }
+            accept_metrics();
+        });
+    }
+    
+    void start_worker_receive(Worker* worker)
+    {
+        worker->sock.async_receive_from(boost::asio::buffer(worker->recv_buffer), worker->remote_endpoint,
+                                        boost::bind(&DVRouter::handle_worker_receive, this, worker,
+                                                    boost::asio::placeholders::error,
+                                                    boost::asio::placeholders::bytes_transferred));
+    }
+    
+    // runs on the worker's own thread: data messages are forwarded from the
+    // current Fib, everything else is queued for the control plane
+    void handle_worker_receive(Worker* worker, const boost::system::error_code& error, size_t bytes_recvd)
+    {
+        if (error == boost::asio::error::operation_aborted) return;
+        if (!error || error == boost::asio::error::message_size)
+        {
+            handle_worker_message(*worker, worker->recv_buffer.data(), bytes_recvd);
+        }
+        start_worker_receive(worker);
+    }
+    
+    void handle_worker_message(Worker& worker, const char* message, size_t len)
+    {
+        worker.metrics.count_rx(message, len);
+        DataHeader data;
+        if (data.parse(message, len))
+            forward_data(worker, data, message, len);
+        else
+            io_service.post(boost::bind(&DVRouter::handle_posted, this, string(message, len)));
+    }
+    
+    void forward_data(Worker& worker, const DataHeader& data, const char* message, size_t len)
+    {
+        if (for_me(data))
+        {
+            log_data_received(data);
+            return;
         }
         
-        // continue listening
-        start_receive();
+        const Fib* current = fib.enter(*worker.fib_reader);
+        uint16_t port;
+        uint32_t hop;
+        bool routed = current->lookup(fib_key(data.dest, data.dest_len), data.flow_hash(), port, hop);
+        if (routed) log_data_relayed(data, port, current->hop_names[hop]);
+        fib.leave(*worker.fib_reader);
+        if (!routed)
+        {
+            worker.metrics.no_route.add();
+            return;
+        }
+        
+        udp::endpoint next_hop(udp::v4(), port);
+        worker.metrics.count_tx(message, len);
+        if (worker.batch_io)
+        {
+            worker.batch_io->send(message, len, next_hop);
+            return;
+        }
+        // the worker's socket is only used by this thread, so a blocking send is fine
+        boost::system::error_code error;
+        worker.sock.send_to(boost::asio::buffer(message, len), next_hop, 0, error);
+        if (error) worker.metrics.send_errors.add();
     }
     
     void handle_send(const boost::system::error_code& error,
-                     std::size_t bytes_transferred)
+                     std::size_t bytes_transferred, SendBuffer buffer)
     {
-        
+        if (error) metrics.send_errors.add();
+        buffer.release(); // back to the pool once every neighbor sharing it is done
     }
     
     udp::socket sock; // udp socket
     string id;  // router id
     uint16_t local_port; // router listening port
-    map<string, shared_ptr<Interface> > neighbors; // Interfaces to neighbors
+    RouterOptions options;
     udp::endpoint remote_endpoint;
-    boost::array<char,MAX_LENGTH> recv_buffer;
-    map<string, RTEntry> RouteTable; // Routing table
-    DV dv; // distance vector
+    SendBuffer rx_slab; // receive buffer, a send slab so data can be relayed from it
+    unique_ptr<BatchUdp> batch_io; // set in batched I/O mode
+    DVShared shared; // name table, send slabs and encode scratch of our DVCore
+    unique_ptr<DVCore> core; // the routing itself
+    LivenessWheel liveness; // Adj-RIB-In row => when the neighbor is declared failed
+    vector<shared_ptr<Interface> > fail_iface; // Adj-RIB-In row => Interface
     boost::asio::deadline_timer dv_timer; // for periodically sending DV to neighbors
+    boost::asio::deadline_timer hold_timer; // triggered-update hold-down window
+    boost::asio::deadline_timer hello_timer; // sends hellos every hello_ms
+    minstd_rand hello_rng; // hello interval jitter
+    boost::asio::deadline_timer wheel_timer; // advances liveness every wheel_tick_ms
+    boost::asio::deadline_timer snapshot_timer; // saves the warm-start snapshot every snapshot_sec
+    boost::asio::signal_set reload_signal; // SIGHUP reloads the topology
+    std::chrono::steady_clock::time_point wheel_start; // tick 0 of liveness
+    int wheel_tick_ms; // ms per liveness tick
     boost::asio::streambuf input_buffer;
     boost::asio::posix::stream_descriptor stdinput;
-    ofstream mylog; // logging file
+    AsyncLog mylog; // logging file
+    FibEpochs fib; // forwarding table, read by the workers and patched by the control plane
+    vector<uint32_t> fib_dirty; // destinations changed since the last publish_fib
+    bool fib_pending; // a publish_fib is queued
+    bool fib_rebuild; // the next publish_fib builds a new Fib
+    vector<unique_ptr<Worker> > workers; // data-plane workers
+    PlaneMetrics metrics; // control plane traffic
+    Histogram dv_latency; // parse and apply time of each DV
+    Histogram loop_lag; // how late the liveness timer fires
+    unique_ptr<boost::asio::local::stream_protocol::acceptor> metrics_acceptor; // set with --metrics-socket
 };
-
 int main(int argc, char** argv)
 {
     //    cout << unitbuf;
     //    setvbuf(stdout, NULL, _IONBF, 0);
     //    setvbuf(stderr, NULL, _IONBF, 0);
     
-    if (argc != 2)
+    if (argc < 2)
     {
-        cout << "Wrong arguments. Correct: ./my-router <id>" << endl;
+        cout << "Wrong arguments. Correct: ./my-router <id> [--topology init.txt|file.dvt] [--delta] [--hold-ms N] [--hello-ms N] [--hello-mult N] [--ecmp N] [--loop-free] [--log-level none|error|info|debug] [--threads N] [--batch N] [--metrics-socket path] [--snapshot path] [--snapshot-sec N]" << endl;
+        cout << "Commands on stdin: cost:B:N, data:B:text, stats, link:B:port:cost, unlink:B, reload (also on SIGHUP)" << endl;
         return 0;
     }
     
     string id = string(argv[1]);
-    uint16_t local_port = 0;
-    map<string, shared_ptr<Interface> > neighbors;
-    
-    ifstream initfile("init.txt");
-    string line;
-    while (getline(initfile, line))
+    string topology = "init.txt";
+    RouterOptions options;
+    for (int i = 2; i < argc; i++)
     {
-        vector<string> tokens;
-        boost::split(tokens, line, boost::is_any_of(","));
-        string src_router = tokens[0];
-        string dest_router = tokens[1];
-        uint16_t port = stoi(tokens[2]);
-        int cost = stoi(tokens[3]);
-        
-        if (id.compare(src_router) == 0)
+        string arg = argv[i];
+        if (arg.compare("--delta") == 0)
         {
-            shared_ptr<Interface> interface(new Interface(port, dest_router, cost));
-            neighbors[dest_router] = interface;
+            options.delta = true;
         }
-        
-        if (local_port == 0 && id.compare(dest_router) == 0)
+        else if (arg.compare("--hold-ms") == 0 && i + 1 < argc)
+        {
+            options.hold_ms = atoi(argv[++i]);
+        }
+        else if (arg.compare("--hello-ms") == 0 && i + 1 < argc)
+        {
+            options.hello_ms = atoi(argv[++i]);
+        }
+        else if (arg.compare("--hello-mult") == 0 && i + 1 < argc)
+        {
+            options.hello_mult = max(1, min(255, atoi(argv[++i])));
+        }
+        else if (arg.compare("--loop-free") == 0)
+        {
+            options.loop_free = true;
+        }
+        else if (arg.compare("--ecmp") == 0 && i + 1 < argc)
+        {
+            options.ecmp = max(1, min(MAX_ECMP, atoi(argv[++i])));
+        }
+        else if (arg.compare("--log-level") == 0 && i + 1 < argc)
+        {
+            string level = argv[++i];
+            if (level.compare("none") == 0) options.log_level = LOG_NONE;
+            else if (level.compare("error") == 0) options.log_level = LOG_ERROR;
+            else if (level.compare("info") == 0) options.log_level = LOG_INFO;
+            else options.log_level = LOG_DEBUG;
+        }
+        else if (arg.compare("--threads") == 0 && i + 1 < argc)
+        {
+            options.threads = atoi(argv[++i]);
+        }
+        else if (arg.compare("--batch") == 0 && i + 1 < argc)
+        {
+            options.batch = atoi(argv[++i]);
+        }
+        else if (arg.compare("--topology") == 0 && i + 1 < argc)
+        {
+            topology = argv[++i];
+        }
+        else if (arg.compare("--metrics-socket") == 0 && i + 1 < argc)
+        {
+            options.metrics_socket = argv[++i];
+        }
+        else if (arg.compare("--snapshot") == 0 && i + 1 < argc)
+        {
+            options.snapshot = argv[++i];
+        }
+        else if (arg.compare("--snapshot-sec") == 0 && i + 1 < argc)
+        {
+            options.snapshot_sec = atoi(argv[++i]);
+        }
+        else
         {
-            local_port = port;
+            cout << "Unknown option: " << arg << endl;
+            return 0;
         }
     }
+    options.topology = topology;
+    uint16_t local_port = 0;
+    map<string, shared_ptr<Interface> > neighbors;
+    read_topology(topology, id, local_port, neighbors);
     
     if (local_port == 0)
     {
@@ -630,7 +968,12 @@ int main(int argc, char** argv)
     
     try
     {
-        DVRouter rt(id, local_port, neighbors);
+        DVRouter rt(id, local_port, neighbors, options);
+        
+        // stop cleanly on SIGINT/SIGTERM so the log writer drains before exit
+        boost::asio::signal_set signals(io_service, SIGINT, SIGTERM);
+        signals.async_wait(boost::bind(&boost::asio::io_service::stop, &io_service));
+        
         io_service.run();
     }
     catch (exception& e)
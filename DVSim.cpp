@@ -0,0 +1,684 @@
+#include <boost/algorithm/string.hpp>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cstdlib>
+
+#include "AsyncLog.h"
+#include "BufferPool.h"
+#include "DVCore.h"
+#include "Topology.h"
+
+// Discrete-event simulator: runs a DVCore for every router of a topology in
+// one process, over a virtual network with configurable latency, jitter and
+// loss, on a virtual clock. Nothing waits for real time, so a run takes as
+// long as the routing work itself. At the end it prints how long routing took
+// to settle and how many messages it cost, and checks the routes against
+// shortest paths computed directly from the topology. --json prints the same
+// report as one JSON object for the benchmark scripts.
+
+#define US_PER_SEC 1000000ULL
+
+// Command-line options
+struct SimOptions : CoreOptions {
+    SimOptions()
+    : topology("init.txt"), duration_sec(60), latency_us(1000), jitter_us(0), loss(0), seed(1),
+    max_cost(10), log_level(LOG_NONE), verify_sources(100), json(false) {}
+
+    string topology; // init.txt-style file, DVTopo index or a Topology.h generator spec
+    double duration_sec; // virtual time to simulate
+    uint64_t latency_us; // one-way link delay
+    uint64_t jitter_us; // extra delay, uniform in [0, jitter_us]
+    double loss; // probability a datagram is dropped
+    uint64_t seed;
+    int max_cost; // generated topologies: link costs are uniform in [1, max_cost]
+    string log_path; // every router's log, interleaved; none if empty
+    LogLevel log_level;
+    size_t verify_sources; // routers whose tables are checked at the end
+    vector<string> events; // scripted "<sec>:<action>" events
+    string name; // label for the run in the report
+    bool json; // report as JSON
+};
+
+// A scripted change to the network, e.g. "20:cost:A:B:50" or "30:fail:F".
+// linkdown/linkup cut and restore a link the routers keep configured;
+// addlink/removelink reconfigure both ends live.
+struct SimEvent {
+    uint64_t at; // virtual microseconds
+    string action; // cost, fail, linkdown, linkup, addlink or removelink
+    string a, b;
+    int cost;
+};
+
+class Simulator;
+
+// One simulated router: a DVCore and the DVHost it runs on
+struct SimRouter : DVHost {
+    SimRouter(Simulator& sim, uint32_t index, string id, uint16_t port)
+    : sim(sim), index(index), id(id), port(port), alive(true), busy_ns(0) {}
+
+    void send(uint16_t port, const SendBuffer& message);
+    void arm_fail_timer(shared_ptr<Interface> interface, int ms);
+    void cancel_fail_timer(shared_ptr<Interface> interface);
+    void arm_hold_timer(int ms);
+    void routes_changed(uint32_t dest);
+
+    Simulator& sim;
+    uint32_t index; // position in Simulator::routers
+    string id;
+    uint16_t port;
+    bool alive; // cleared by a fail event
+    uint64_t busy_ns; // wall time spent in this router's handlers
+    map<string, shared_ptr<Interface> > neighbors;
+    vector<uint32_t> fail_generation; // Adj-RIB-In row => generation of the live failure timer
+    unique_ptr<DVCore> core;
+};
+
+class Simulator {
+    // kinds of scheduled events
+    enum { EV_DELIVER, EV_DV_TIMER, EV_FAIL_TIMER, EV_HOLD_TIMER, EV_HELLO_TIMER, EV_SCRIPT };
+
+    struct Event {
+        uint64_t at; // virtual microseconds
+        uint64_t seq; // keeps events at the same time in scheduling order
+        int type;
+        uint32_t router;
+        uint32_t arg; // EV_DELIVER: sending router; EV_FAIL_TIMER: row; EV_SCRIPT: event
+        uint32_t generation; // EV_FAIL_TIMER: must match the row's current generation
+        SendBuffer message; // EV_DELIVER
+
+        bool operator>(const Event& other) const
+        {
+            return at != other.at ? at > other.at : seq > other.seq;
+        }
+    };
+
+public:
+    Simulator(const SimOptions& options)
+    : options(options), shared(2048), now(0), seq(0), rng(options.seed),
+    sent(0), sent_bytes(0), lost(0), route_changes(0), last_change(0), initial_settled(0)
+    {
+        if (!options.log_path.empty()) mylog.open(options.log_path);
+        mylog.set_level(options.log_path.empty() ? LOG_NONE : options.log_level);
+        router_of_port.assign(65536, NO_ID);
+    }
+
+    ~Simulator()
+    {
+        mylog.close();
+    }
+
+    // load an init.txt-style file, an indexed topology written by DVTopo, or,
+    // for a path that is not a file, a generator spec such as "ring:100"
+    bool load(const string& path)
+    {
+        if (TopologyIndex::is_index(path))
+        {
+            TopologyIndex index;
+            if (!index.open(path))
+            {
+                cerr << "Bad topology index " << path << endl;
+                return false;
+            }
+            load(index);
+            return true;
+        }
+
+        Topology topo;
+        string error;
+        if (ifstream(path.c_str()))
+        {
+            if (!topo.read_text(path, error))
+            {
+                cerr << error << endl;
+                return false;
+            }
+        }
+        else if (!TopologyGenerator(options.seed, options.max_cost).generate(path, topo))
+        {
+            cerr << "Cannot open topology " << path << endl;
+            return false;
+        }
+        load(topo);
+        return true;
+    }
+
+    void load(const Topology& topo)
+    {
+        for (size_t i = 0; i < topo.size(); i++)
+            router(topo.names[i], topo.ports[i]);
+        for (auto& link : topo.links)
+        {
+            SimRouter& dest = *routers[link.dest];
+            routers[link.src]->neighbors[dest.id] = shared_ptr<Interface>(new Interface(dest.port, dest.id, link.cost));
+        }
+        links = topo.links.size();
+    }
+
+    void load(const TopologyIndex& index)
+    {
+        for (uint32_t i = 0; i < index.size(); i++)
+            router(index.name(i), index.port(i));
+        for (uint32_t i = 0; i < index.size(); i++)
+        {
+            for (const TopologyIndex::Link* link = index.links_begin(i); link != index.links_end(i); link++)
+            {
+                SimRouter& dest = *routers[link->dest];
+                routers[i]->neighbors[dest.id] = shared_ptr<Interface>(new Interface(dest.port, dest.id, link->cost));
+            }
+        }
+        links = index.link_count();
+    }
+
+    bool add_event(const string& spec)
+    {
+        vector<string> tokens;
+        boost::split(tokens, spec, boost::is_any_of(":"));
+        SimEvent event;
+        event.cost = 0;
+        if (tokens.size() < 3) return false;
+        event.at = (uint64_t) (atof(tokens[0].c_str()) * US_PER_SEC);
+        event.action = tokens[1];
+        event.a = tokens[2];
+        if ((event.action == "cost" || event.action == "addlink") && tokens.size() == 5)
+        {
+            event.b = tokens[3];
+            event.cost = atoi(tokens[4].c_str());
+        }
+        else if ((event.action == "linkdown" || event.action == "linkup" || event.action == "removelink") &&
+                 tokens.size() == 4)
+        {
+            event.b = tokens[3];
+        }
+        else if (!(event.action == "fail" && tokens.size() == 3))
+        {
+            return false;
+        }
+        if (index_of.count(event.a) == 0 || (!event.b.empty() && index_of.count(event.b) == 0))
+            return false;
+        script.push_back(event);
+        return true;
+    }
+
+    void run()
+    {
+        for (auto& r : routers)
+        {
+            r->core.reset(new DVCore(*r, r->id, r->port, r->neighbors, options, shared, mylog));
+            r->fail_generation.assign(r->neighbors.size(), 0);
+        }
+        // routers start their DV timers at random offsets, as separately started processes would
+        std::uniform_int_distribution<uint64_t> start(0, DV_SEND_SEC * US_PER_SEC - 1);
+        for (auto& r : routers)
+            schedule(start(rng), EV_DV_TIMER, r->index, 0, 0, SendBuffer());
+        if (options.hello_ms > 0)
+        {
+            for (auto& r : routers)
+                schedule(start(rng) % (options.hello_ms * 1000ULL), EV_HELLO_TIMER, r->index, 0, 0, SendBuffer());
+        }
+        for (size_t i = 0; i < script.size(); i++)
+            schedule(script[i].at, EV_SCRIPT, 0, (uint32_t) i, 0, SendBuffer());
+        script_changes.assign(script.size(), 0);
+        script_sent.assign(script.size(), make_pair(0, 0));
+
+        uint64_t end = (uint64_t) (options.duration_sec * US_PER_SEC);
+        auto wall_start = std::chrono::steady_clock::now();
+        while (!events.empty() && events.top().at <= end)
+        {
+            Event event = events.top();
+            events.pop();
+            now = event.at;
+            if (event.type == EV_SCRIPT)
+            {
+                dispatch(event);
+                continue;
+            }
+            auto busy_start = std::chrono::steady_clock::now();
+            dispatch(event);
+            routers[event.router]->busy_ns +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - busy_start).count();
+        }
+        now = end;
+        wall_sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+    }
+
+    void report()
+    {
+        size_t checked = 0, wrong = 0, multipath = 0;
+        verify(checked, wrong, multipath);
+
+        // per-router cost: the busiest router and the mean, in CPU microseconds
+        // and bytes of routing state
+        uint64_t busy_total = 0, busy_max = 0;
+        size_t table_total = 0, table_max = 0;
+        for (auto& r : routers)
+        {
+            busy_total += r->busy_ns;
+            busy_max = max(busy_max, r->busy_ns);
+            size_t bytes = r->core->table_bytes();
+            table_total += bytes;
+            table_max = max(table_max, bytes);
+        }
+        size_t n = max((size_t) 1, routers.size());
+        double sim_sec = now / (double) US_PER_SEC;
+
+        if (options.json)
+        {
+            printf("{\"name\":\"%s\",\"topology\":\"%s\",\"routers\":%zu,\"links\":%zu,\"delta\":%s,\"hold_ms\":%d,\"hello_ms\":%d,\"ecmp\":%d,\"loop_free\":%s,"
+                   "\"seed\":%llu,\"sim_sec\":%.3f,\"wall_sec\":%.3f,\"converged_sec\":%.6f,"
+                   "\"messages\":%llu,\"bytes\":%llu,\"lost\":%llu,\"route_changes\":%llu,"
+                   "\"peak_table_bytes\":%zu,\"peak_table_bytes_per_router\":%zu,\"max_table_bytes_router\":%zu,"
+                   "\"cpu_us\":%.1f,\"cpu_us_per_router\":%.1f,\"max_cpu_us_router\":%.1f,\"events\":[",
+                   options.name.c_str(), options.topology.c_str(), routers.size(), links, options.delta ? "true" : "false", options.hold_ms, options.hello_ms,
+                   options.ecmp, options.loop_free ? "true" : "false", (unsigned long long) options.seed, sim_sec, wall_sec, initial_settled / (double) US_PER_SEC,
+                   (unsigned long long) sent, (unsigned long long) sent_bytes, (unsigned long long) lost,
+                   (unsigned long long) route_changes, table_total, table_total / n, table_max,
+                   busy_total / 1e3, busy_total / 1e3 / n, busy_max / 1e3);
+            for (size_t i = 0; i < script.size(); i++)
+            {
+                const SimEvent& event = script[i];
+                pair<uint64_t, uint64_t> cost = event_traffic(i);
+                printf("%s{\"at_sec\":%.3f,\"action\":\"%s\",\"a\":\"%s\",\"b\":\"%s\",\"settled_sec\":%.6f,"
+                       "\"messages\":%llu,\"bytes\":%llu}", i ? "," : "", event.at / (double) US_PER_SEC,
+                       event.action.c_str(), event.a.c_str(), event.b.c_str(), settle_time(i),
+                       (unsigned long long) cost.first, (unsigned long long) cost.second);
+            }
+            printf("],\"multipath_routes\":%zu,\"routes_checked\":%zu,\"routes_wrong\":%zu}\n", multipath, checked, wrong);
+            return;
+        }
+
+        printf("routers %zu, links %zu, simulated %.1f s in %.3f s (%.0fx real time)\n",
+               routers.size(), links, sim_sec, wall_sec, wall_sec > 0 ? sim_sec / wall_sec : 0.0);
+        printf("messages sent %llu (%llu bytes), lost %llu\n",
+               (unsigned long long) sent, (unsigned long long) sent_bytes, (unsigned long long) lost);
+        printf("route changes %llu, last at %.3f s, converged at %.3f s\n", (unsigned long long) route_changes,
+               last_change / (double) US_PER_SEC, initial_settled / (double) US_PER_SEC);
+        printf("routing state %zu bytes, %zu per router (max %zu); cpu %.1f us per router (max %.1f)\n",
+               table_total, table_total / n, table_max, busy_total / 1e3 / n, busy_max / 1e3);
+        for (size_t i = 0; i < script.size(); i++)
+        {
+            const SimEvent& event = script[i];
+            pair<uint64_t, uint64_t> cost = event_traffic(i);
+            printf("event %.3f s %s %s%s%s: settled after %.3f s, %llu messages (%llu bytes)\n",
+                   event.at / (double) US_PER_SEC, event.action.c_str(), event.a.c_str(),
+                   event.b.empty() ? "" : " ", event.b.c_str(), settle_time(i),
+                   (unsigned long long) cost.first, (unsigned long long) cost.second);
+        }
+        printf("routes checked %zu, wrong %zu, with several equal-cost next hops %zu\n", checked, wrong, multipath);
+    }
+
+    // a router put a datagram on the wire
+    void transmit(SimRouter& from, uint16_t port, const SendBuffer& message)
+    {
+        if (!from.alive) return;
+        uint32_t to = router_of_port[port];
+        if (to == NO_ID) return;
+        sent++;
+        sent_bytes += message.size();
+        if (down_links.count(make_pair(min(from.index, to), max(from.index, to))) ||
+            (options.loss > 0 && std::uniform_real_distribution<double>(0, 1)(rng) < options.loss))
+        {
+            lost++;
+            return;
+        }
+        uint64_t delay = options.latency_us;
+        if (options.jitter_us > 0)
+            delay += std::uniform_int_distribution<uint64_t>(0, options.jitter_us)(rng);
+        schedule(now + delay, EV_DELIVER, to, from.index, 0, message);
+    }
+
+    void arm_fail_timer(SimRouter& r, size_t row, int ms)
+    {
+        if (r.fail_generation.size() <= row) r.fail_generation.resize(row + 1, 0);
+        uint32_t generation = ++r.fail_generation[row];
+        schedule(now + ms * 1000ULL, EV_FAIL_TIMER, r.index, (uint32_t) row, generation, SendBuffer());
+    }
+
+    void arm_hold_timer(SimRouter& r, int ms)
+    {
+        schedule(now + ms * 1000ULL, EV_HOLD_TIMER, r.index, 0, 0, SendBuffer());
+    }
+
+    void route_changed()
+    {
+        route_changes++;
+        last_change = now;
+        if (!executed.empty())
+            script_changes[executed.back()] = now;
+        else
+            initial_settled = now;
+    }
+
+private:
+    SimRouter& router(const string& id, uint16_t port)
+    {
+        auto it = index_of.find(id);
+        if (it == index_of.end())
+        {
+            uint32_t index = (uint32_t) routers.size();
+            routers.push_back(unique_ptr<SimRouter>(new SimRouter(*this, index, id, 0)));
+            it = index_of.insert(make_pair(id, index)).first;
+        }
+        SimRouter& r = *routers[it->second];
+        if (port != 0 && r.port == 0)
+        {
+            r.port = port;
+            router_of_port[port] = r.index;
+        }
+        return r;
+    }
+
+    void schedule(uint64_t at, int type, uint32_t router, uint32_t arg, uint32_t generation,
+                  const SendBuffer& message)
+    {
+        Event event;
+        event.at = at;
+        event.seq = seq++;
+        event.type = type;
+        event.router = router;
+        event.arg = arg;
+        event.generation = generation;
+        event.message = message;
+        events.push(event);
+    }
+
+    void dispatch(const Event& event)
+    {
+        if (event.type == EV_SCRIPT)
+        {
+            execute(event.arg);
+            return;
+        }
+
+        SimRouter& r = *routers[event.router];
+        if (!r.alive) return;
+        switch (event.type)
+        {
+            case EV_DELIVER:
+                if (down_links.count(make_pair(min(event.arg, r.index), max(event.arg, r.index))))
+                {
+                    lost++; // the link went down while the datagram was in flight
+                    return;
+                }
+                r.core->handle_control(event.message.data(), event.message.size());
+                break;
+            case EV_DV_TIMER:
+                r.core->on_dv_timer();
+                schedule(now + DV_SEND_SEC * US_PER_SEC, EV_DV_TIMER, r.index, 0, 0, SendBuffer());
+                break;
+            case EV_FAIL_TIMER:
+                if (event.generation == r.fail_generation[event.arg])
+                    r.core->neighbor_timeout(row_interface(r, event.arg));
+                break;
+            case EV_HOLD_TIMER:
+                r.core->on_hold_timer();
+                break;
+            case EV_HELLO_TIMER:
+            {
+                r.core->on_hello_timer();
+                // each interval shortened by up to a quarter, as DVRouter does
+                uint64_t jitter = std::uniform_int_distribution<uint64_t>(0, options.hello_ms * 250ULL)(rng);
+                schedule(now + options.hello_ms * 1000ULL - jitter, EV_HELLO_TIMER, r.index, 0, 0, SendBuffer());
+                break;
+            }
+        }
+    }
+
+    shared_ptr<Interface> row_interface(SimRouter& r, size_t row)
+    {
+        for (auto& i : r.neighbors)
+        {
+            if (i.second->row == row) return i.second;
+        }
+        return shared_ptr<Interface>();
+    }
+
+    // time from a script event to the last route change it caused
+    double settle_time(size_t i)
+    {
+        const SimEvent& event = script[i];
+        return script_changes[i] > event.at ? (script_changes[i] - event.at) / (double) US_PER_SEC : 0;
+    }
+
+    // messages and bytes sent between a script event and the next one (or the end)
+    pair<uint64_t, uint64_t> event_traffic(size_t i)
+    {
+        size_t k = find(executed.begin(), executed.end(), i) - executed.begin();
+        if (k == executed.size()) return make_pair(0, 0);
+        pair<uint64_t, uint64_t> until = k + 1 < executed.size() ? script_sent[executed[k + 1]] : make_pair(sent, sent_bytes);
+        return make_pair(until.first - script_sent[i].first, until.second - script_sent[i].second);
+    }
+
+    void execute(size_t i)
+    {
+        const SimEvent& event = script[i];
+        executed.push_back(i);
+        script_sent[i] = make_pair(sent, sent_bytes);
+        SimRouter& a = *routers[index_of[event.a]];
+        if (event.action == "cost")
+        {
+            a.core->change_cost(event.b, event.cost, true, false);
+        }
+        else if (event.action == "fail")
+        {
+            a.alive = false;
+        }
+        else if (event.action == "addlink" || event.action == "removelink")
+        {
+            SimRouter& b = *routers[index_of[event.b]];
+            bool add = event.action == "addlink";
+            if (add && a.neighbors.count(b.id) == 0) links += 2;
+            if (!add && a.neighbors.count(b.id) != 0) links -= 2;
+            if (add)
+            {
+                a.core->add_neighbor(b.id, b.port, event.cost);
+                b.core->add_neighbor(a.id, a.port, event.cost);
+            }
+            else
+            {
+                a.core->remove_neighbor(b.id);
+                b.core->remove_neighbor(a.id);
+            }
+            // the final topology verify() checks against
+            a.neighbors = a.core->interfaces();
+            b.neighbors = b.core->interfaces();
+        }
+        else
+        {
+            uint32_t b = index_of[event.b];
+            pair<uint32_t, uint32_t> link(min(a.index, b), max(a.index, b));
+            if (event.action == "linkdown")
+                down_links.insert(link);
+            else
+                down_links.erase(link);
+        }
+    }
+
+    // link cost a router currently uses toward a neighbor, INF if unusable
+    int link_cost(const SimRouter& from, const Interface& interface)
+    {
+        uint32_t to = router_of_port[interface.port];
+        if (to == NO_ID || !routers[to]->alive) return INF;
+        if (down_links.count(make_pair(min(from.index, to), max(from.index, to)))) return INF;
+        return interface.cost;
+    }
+
+    // compare the routers' distances with Dijkstra over the final topology
+    // multipath counts the checked routes with more than one equal-cost next hop
+    void verify(size_t& checked, size_t& wrong, size_t& multipath)
+    {
+        size_t n = routers.size();
+        size_t step = max((size_t) 1, n / max((size_t) 1, options.verify_sources));
+        vector<int64_t> dist(n);
+        for (size_t s = 0; s < n && options.verify_sources > 0; s += step)
+        {
+            SimRouter& src = *routers[s];
+            if (!src.alive) continue;
+
+            fill(dist.begin(), dist.end(), (int64_t) INF);
+            dist[s] = 0;
+            priority_queue<pair<int64_t, uint32_t>, vector<pair<int64_t, uint32_t> >,
+                           greater<pair<int64_t, uint32_t> > > queue;
+            queue.push(make_pair(0, (uint32_t) s));
+            while (!queue.empty())
+            {
+                pair<int64_t, uint32_t> top = queue.top();
+                queue.pop();
+                if (top.first > dist[top.second]) continue;
+                SimRouter& u = *routers[top.second];
+                for (auto& i : u.neighbors)
+                {
+                    int cost = link_cost(u, *i.second);
+                    uint32_t v = router_of_port[i.second->port];
+                    if (cost >= INF || top.first + cost >= dist[v]) continue;
+                    dist[v] = top.first + cost;
+                    queue.push(make_pair(dist[v], v));
+                }
+            }
+
+            const Rib& rib = src.core->routes();
+            const IdTable& ids = src.core->names();
+            for (size_t d = 0; d < n; d++)
+            {
+                if (d == s || !routers[d]->alive) continue;
+                uint32_t dest = ids.find(routers[d]->id);
+                int64_t have = INF;
+                if (dest != NO_ID && src.core->has_route(dest)) have = min((int64_t) rib.distance[dest], (int64_t) INF);
+                checked++;
+                if (have != min(dist[d], (int64_t) INF)) wrong++;
+                if (have < INF && rib.max_paths > 1 && rib.path_count[dest] > 1) multipath++;
+            }
+        }
+    }
+
+    SimOptions options;
+    DVShared shared; // every router's names, send slabs and encode scratch
+    AsyncLog mylog;
+    vector<unique_ptr<SimRouter> > routers;
+    map<string, uint32_t> index_of; // router id => index
+    vector<uint32_t> router_of_port; // port => router index
+    size_t links = 0;
+    vector<SimEvent> script;
+    vector<size_t> executed; // script events run so far, in order
+    vector<uint64_t> script_changes; // script event => time of the last route change it caused
+    vector<pair<uint64_t, uint64_t> > script_sent; // script event => messages and bytes sent before it ran
+    set<pair<uint32_t, uint32_t> > down_links; // (lower index, higher index)
+    priority_queue<Event, vector<Event>, greater<Event> > events;
+    uint64_t now; // virtual microseconds
+    uint64_t seq;
+    std::mt19937_64 rng;
+    uint64_t sent, sent_bytes, lost;
+    uint64_t route_changes;
+    uint64_t last_change; // time of the last route change
+    uint64_t initial_settled; // time of the last route change before the first script event
+    double wall_sec = 0;
+};
+
+void SimRouter::send(uint16_t port, const SendBuffer& message)
+{
+    sim.transmit(*this, port, message);
+}
+
+void SimRouter::arm_fail_timer(shared_ptr<Interface> interface, int ms)
+{
+    sim.arm_fail_timer(*this, interface->row, ms);
+}
+
+void SimRouter::cancel_fail_timer(shared_ptr<Interface> interface)
+{
+    if (interface->row < fail_generation.size()) fail_generation[interface->row]++;
+}
+
+void SimRouter::arm_hold_timer(int ms)
+{
+    sim.arm_hold_timer(*this, ms);
+}
+
+void SimRouter::routes_changed(uint32_t dest)
+{
+    if (dest != NO_ID) sim.route_changed();
+}
+
+int main(int argc, char** argv)
+{
+    SimOptions options;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg.compare("--delta") == 0)
+            options.delta = true;
+        else if (arg.compare("--hold-ms") == 0 && has_value)
+            options.hold_ms = atoi(argv[++i]);
+        else if (arg.compare("--hello-ms") == 0 && has_value)
+            options.hello_ms = atoi(argv[++i]);
+        else if (arg.compare("--hello-mult") == 0 && has_value)
+            options.hello_mult = max(1, min(255, atoi(argv[++i])));
+        else if (arg.compare("--loop-free") == 0)
+            options.loop_free = true;
+        else if (arg.compare("--ecmp") == 0 && has_value)
+            options.ecmp = max(1, min(MAX_ECMP, atoi(argv[++i])));
+        else if (arg.compare("--topology") == 0 && has_value)
+            options.topology = argv[++i];
+        else if (arg.compare("--duration") == 0 && has_value)
+            options.duration_sec = atof(argv[++i]);
+        else if (arg.compare("--latency-ms") == 0 && has_value)
+            options.latency_us = (uint64_t) (atof(argv[++i]) * 1000);
+        else if (arg.compare("--jitter-ms") == 0 && has_value)
+            options.jitter_us = (uint64_t) (atof(argv[++i]) * 1000);
+        else if (arg.compare("--loss") == 0 && has_value)
+            options.loss = atof(argv[++i]);
+        else if (arg.compare("--seed") == 0 && has_value)
+            options.seed = strtoull(argv[++i], NULL, 10);
+        else if (arg.compare("--max-cost") == 0 && has_value)
+            options.max_cost = atoi(argv[++i]);
+        else if (arg.compare("--log") == 0 && has_value)
+            options.log_path = argv[++i];
+        else if (arg.compare("--log-level") == 0 && has_value)
+        {
+            string level = argv[++i];
+            if (level.compare("none") == 0) options.log_level = LOG_NONE;
+            else if (level.compare("error") == 0) options.log_level = LOG_ERROR;
+            else if (level.compare("info") == 0) options.log_level = LOG_INFO;
+            else options.log_level = LOG_DEBUG;
+        }
+        else if (arg.compare("--verify") == 0 && has_value)
+            options.verify_sources = atoi(argv[++i]);
+        else if (arg.compare("--event") == 0 && has_value)
+            options.events.push_back(argv[++i]);
+        else if (arg.compare("--name") == 0 && has_value)
+            options.name = argv[++i];
+        else if (arg.compare("--json") == 0)
+            options.json = true;
+        else
+        {
+            cout << "Usage: ./DVSim [--topology init.txt|line:N|ring:N|grid:WxH|scalefree:N[:M]] [--duration sec]"
+            << " [--latency-ms ms] [--jitter-ms ms] [--loss p] [--seed n] [--max-cost n] [--delta] [--hold-ms ms]"
+            << " [--hello-ms ms] [--hello-mult n] [--ecmp n] [--loop-free]"
+            << " [--log file] [--log-level none|error|info|debug] [--verify routers]"
+            << " [--event sec:cost:A:B:N|sec:fail:A|sec:linkdown:A:B|sec:linkup:A:B|sec:addlink:A:B:N|sec:removelink:A:B]... [--name label] [--json]" << endl;
+            return 0;
+        }
+    }
+
+    Simulator sim(options);
+    if (!sim.load(options.topology)) return 1;
+    for (auto& spec : options.events)
+    {
+        if (!sim.add_event(spec))
+        {
+            cerr << "Bad event: " << spec << endl;
+            return 1;
+        }
+    }
+    sim.run();
+    sim.report();
+    return 0;
+}
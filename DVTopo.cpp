@@ -0,0 +1,80 @@
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdint.h>
+
+#include "Topology.h"
+
+// Topology tool: generates a seeded topology (or reads an init.txt-style
+// file) and writes it as init.txt text, as an indexed file that routers
+// memory-map with --topology, or both.
+
+using namespace std;
+
+int main(int argc, char** argv)
+{
+    string source;
+    string text_path, index_path;
+    uint64_t seed = 1;
+    int max_cost = 10;
+    int base_port = 10000;
+    for (int i = 1; i < argc; i++)
+    {
+        string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg.compare("--seed") == 0 && has_value)
+            seed = strtoull(argv[++i], NULL, 10);
+        else if (arg.compare("--max-cost") == 0 && has_value)
+            max_cost = atoi(argv[++i]);
+        else if (arg.compare("--base-port") == 0 && has_value)
+            base_port = atoi(argv[++i]);
+        else if (arg.compare("--text") == 0 && has_value)
+            text_path = argv[++i];
+        else if (arg.compare("--index") == 0 && has_value)
+            index_path = argv[++i];
+        else if (source.empty() && arg[0] != '-')
+            source = arg;
+        else
+        {
+            source.clear();
+            break;
+        }
+    }
+    if (source.empty() || base_port <= 0 || base_port > 65535)
+    {
+        cout << "Usage: ./DVTopo <init.txt|line:N|ring:N|grid:WxH|scalefree:N[:M]> [--seed n] [--max-cost n]"
+        << " [--base-port port] [--text out.txt] [--index out.dvt]" << endl
+        << "Writes the topology as text to stdout unless --text or --index is given." << endl;
+        return 0;
+    }
+
+    Topology topo;
+    string error;
+    if (TopologyIndex::is_index(source))
+    {
+        cerr << source << " is already indexed" << endl;
+        return 1;
+    }
+    if (!TopologyGenerator(seed, max_cost, (uint16_t) base_port).generate(source, topo) &&
+        !topo.read_text(source, error))
+    {
+        cerr << error << endl;
+        return 1;
+    }
+
+    if (text_path.empty() && index_path.empty())
+        topo.write_text(stdout);
+    if (!text_path.empty() && !topo.write_text(text_path))
+    {
+        cerr << "Cannot write " << text_path << endl;
+        return 1;
+    }
+    if (!index_path.empty() && !topo.write_index(index_path))
+    {
+        cerr << "Cannot write " << index_path << endl;
+        return 1;
+    }
+    cerr << topo.size() << " routers, " << topo.links.size() << " links" << endl;
+    return 0;
+}
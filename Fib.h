@@ -0,0 +1,238 @@
+#ifndef FIB_H
+#define FIB_H
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Key of a destination name in the Fib: FNV-1a 64, never 0 (an empty slot).
+// Forwarding trusts the key alone; two names colliding in 64 bits among a
+// routing domain's few thousand is not a practical concern.
+inline uint64_t fib_key(const char* name, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; i++)
+    {
+        h ^= (uint8_t) name[i];
+        h *= 1099511628211ULL;
+    }
+    return h ? h : 1;
+}
+
+// Forwarding information base: destination name => (port, next hop index),
+// kept apart from the routing table. Open addressing over 64-byte buckets of
+// WAYS keys and their values, so a lookup of a single-path destination reads
+// one cache line. The table is at most half full and never deletes (a lost
+// route is stored as port 0), so a probe ends at the first empty slot.
+//
+// One thread (the control plane) writes; any number read concurrently
+// without locks. Changing a route stores its value word in place; a new
+// destination stores its value before publishing its key. ECMP next hops
+// live in a side array, read only for destinations with several of them.
+class Fib {
+    const static size_t WAYS = 4;
+
+    struct Bucket {
+        std::atomic<uint64_t> key[WAYS]; // 0 if the slot is empty
+        std::atomic<uint64_t> value[WAYS]; // see pack()
+    };
+
+public:
+    // room for routes destinations at most max_paths next hops each
+    Fib(size_t routes, size_t max_paths) : count(0), max_paths(max_paths)
+    {
+        size_t n = 1;
+        while (n * WAYS < 2 * routes + WAYS) n *= 2;
+        mask = n - 1;
+        void* memory = NULL;
+        if (posix_memalign(&memory, 64, n * sizeof(Bucket)) != 0) throw std::bad_alloc();
+        buckets = (Bucket*) memory;
+        for (size_t b = 0; b < n; b++)
+        {
+            for (size_t w = 0; w < WAYS; w++)
+            {
+                new (&buckets[b].key[w]) std::atomic<uint64_t>(0);
+                new (&buckets[b].value[w]) std::atomic<uint64_t>(0);
+            }
+        }
+        if (max_paths > 1)
+        {
+            paths.reset(new std::atomic<uint64_t>[n * WAYS * max_paths]);
+            for (size_t i = 0; i < n * WAYS * max_paths; i++) paths[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    ~Fib() { free(buckets); }
+
+    // the next hop of a flow to the destination with this key; false if there is no route
+    bool lookup(uint64_t key, size_t flow_hash, uint16_t& port, uint32_t& next_hop) const
+    {
+        size_t slot;
+        uint64_t value = find(key, slot);
+        if ((value & 0xFFFF) == 0) return false;
+        size_t path_count = (value >> 16) & 0xFF;
+        if (path_count > 1)
+        {
+            uint64_t path = paths[slot * max_paths + flow_hash % path_count].load(std::memory_order_relaxed);
+            if (path & 0xFFFF) value = path;
+        }
+        port = (uint16_t) (value & 0xFFFF);
+        next_hop = (uint32_t) (value >> 32);
+        return true;
+    }
+
+    // writer: set a destination's next hops, the first of path_count being
+    // (port, next_hop). false if it is new and the table is full: build a
+    // larger one then.
+    bool set(uint64_t key, uint16_t port, uint32_t next_hop,
+             const uint16_t* path_ports, const uint32_t* path_hops, size_t path_count)
+    {
+        if (max_paths <= 1 || port == 0) path_count = 0;
+        path_count = std::min(path_count, max_paths);
+        for (size_t b = key & mask, probes = 0; probes <= mask; b = (b + 1) & mask, probes++)
+        {
+            for (size_t w = 0; w < WAYS; w++)
+            {
+                uint64_t k = buckets[b].key[w].load(std::memory_order_relaxed);
+                if (k != key && k != 0) continue;
+                if (k == 0 && 2 * (count + 1) > (mask + 1) * WAYS) return false;
+                size_t slot = b * WAYS + w;
+                for (size_t i = 0; i < path_count; i++)
+                    store(paths[slot * max_paths + i], pack(path_ports[i], path_hops[i], 0));
+                store(buckets[b].value[w], pack(port, next_hop, path_count));
+                if (k == 0)
+                {
+                    buckets[b].key[w].store(key, std::memory_order_release);
+                    count++;
+                }
+                return true;
+            }
+        }
+        return false;
+    }
+
+    size_t size() const { return count; }
+
+    std::vector<std::string> hop_names; // router index => name, for the neighbors; for logging
+
+private:
+    static uint64_t pack(uint16_t port, uint32_t next_hop, size_t path_count)
+    {
+        return (uint64_t) port | ((uint64_t) path_count << 16) | ((uint64_t) next_hop << 32);
+    }
+
+    // only written words change, so readers' cache lines stay valid otherwise
+    static void store(std::atomic<uint64_t>& word, uint64_t value)
+    {
+        if (word.load(std::memory_order_relaxed) != value) word.store(value, std::memory_order_relaxed);
+    }
+
+    uint64_t find(uint64_t key, size_t& slot) const
+    {
+        for (size_t b = key & mask, probes = 0; probes <= mask; b = (b + 1) & mask, probes++)
+        {
+            for (size_t w = 0; w < WAYS; w++)
+            {
+                uint64_t k = buckets[b].key[w].load(std::memory_order_acquire);
+                if (k == 0) return 0;
+                if (k != key) continue;
+                slot = b * WAYS + w;
+                return buckets[b].value[w].load(std::memory_order_relaxed);
+            }
+        }
+        return 0;
+    }
+
+    Bucket* buckets; // 64-byte aligned
+    size_t mask; // buckets - 1
+    size_t count; // destinations stored
+    size_t max_paths;
+    std::unique_ptr<std::atomic<uint64_t>[]> paths; // slot * max_paths + i => i-th next hop, with ECMP
+};
+
+// Epoch-based reclamation of replaced Fibs. Readers mark themselves active
+// in the current epoch for the duration of a lookup; a Fib replaced in epoch
+// e is freed once every reader is idle or active in e or later, as none of
+// them can still hold it.
+class FibEpochs {
+public:
+    struct Reader {
+        Reader() : epoch(0) {}
+        std::atomic<uint64_t> epoch; // 0 while idle
+        char pad[64 - sizeof(std::atomic<uint64_t>)]; // one cache line per reader
+    };
+
+    FibEpochs() : current(NULL), global(1) {}
+
+    ~FibEpochs()
+    {
+        delete current.load();
+        for (auto& r : retired) delete r.second;
+    }
+
+    // register a reader; before the reading threads start
+    Reader* add_reader()
+    {
+        readers.push_back(std::unique_ptr<Reader>(new Reader()));
+        return readers.back().get();
+    }
+
+    // reader: the Fib to use until leave()
+    const Fib* enter(Reader& reader) const
+    {
+        reader.epoch.store(global.load());
+        return current.load();
+    }
+
+    void leave(Reader& reader) const
+    {
+        reader.epoch.store(0, std::memory_order_release);
+    }
+
+    // writer: the current Fib, which it may patch in place
+    Fib* get() const { return current.load(std::memory_order_relaxed); }
+
+    // writer: switch readers to next and retire the one it replaces
+    void replace(Fib* next)
+    {
+        Fib* old = current.exchange(next);
+        uint64_t epoch = ++global;
+        if (old) retired.push_back(std::make_pair(epoch, old));
+        reclaim();
+    }
+
+    // writer: free the retired Fibs no reader can still hold
+    void reclaim()
+    {
+        if (retired.empty()) return;
+        uint64_t oldest = UINT64_MAX;
+        for (auto& reader : readers)
+        {
+            uint64_t epoch = reader->epoch.load();
+            if (epoch != 0 && epoch < oldest) oldest = epoch;
+        }
+        size_t kept = 0;
+        for (size_t i = 0; i < retired.size(); i++)
+        {
+            if (retired[i].first <= oldest)
+                delete retired[i].second;
+            else
+                retired[kept++] = retired[i];
+        }
+        retired.resize(kept);
+    }
+
+private:
+    std::atomic<Fib*> current;
+    std::atomic<uint64_t> global; // bumped on every replace
+    std::vector<std::unique_ptr<Reader> > readers;
+    std::vector<std::pair<uint64_t, Fib*> > retired; // epoch replaced in => Fib
+};
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <cstdio>
+#include <stdint.h>
+#include <string>
+
+// Counters and latency histograms cheap enough to leave on in production.
+// Each one has a single writing thread, which updates it with a relaxed load
+// and store: no locked instruction, yet another thread can read it at any
+// time. Threads that need the same metric keep their own and the reader sums
+// them.
+class Counter {
+public:
+    Counter() : v(0) {}
+
+    void add(uint64_t n = 1) { v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+    uint64_t get() const { return v.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> v;
+};
+
+// Power-of-two buckets of microseconds: bucket i counts samples of at most
+// 2^i us, the last one everything longer (about 4 s and up).
+class Histogram {
+public:
+    const static size_t BUCKETS = 23;
+
+    void observe_us(uint64_t us)
+    {
+        size_t i = 0;
+        while (i + 1 < BUCKETS && (1ULL << i) < us) i++;
+        buckets[i].add();
+        sum_us.add(us);
+    }
+
+    uint64_t bucket(size_t i) const { return buckets[i].get(); }
+    uint64_t sum() const { return sum_us.get(); }
+
+private:
+    Counter buckets[BUCKETS];
+    Counter sum_us;
+};
+
+// Prometheus text exposition format: a family's HELP and TYPE lines, then
+// its samples
+class MetricsWriter {
+public:
+    void family(const char* name, const char* type, const char* help)
+    {
+        out += "# HELP ";
+        out += name;
+        out += " ";
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += " ";
+        out += type;
+        out += "\n";
+    }
+
+    // labels is empty or like type="dv"
+    void sample(const char* name, const std::string& labels, uint64_t value)
+    {
+        out += name;
+        if (!labels.empty()) out += "{" + labels + "}";
+        out += " " + std::to_string(value) + "\n";
+    }
+
+    void counter(const char* name, const char* help, uint64_t value)
+    {
+        family(name, "counter", help);
+        sample(name, "", value);
+    }
+
+    void gauge(const char* name, const char* help, uint64_t value)
+    {
+        family(name, "gauge", help);
+        sample(name, "", value);
+    }
+
+    // the sum of histograms kept by several threads, in seconds
+    void histogram(const char* name, const char* help, const Histogram* const* parts, size_t count)
+    {
+        family(name, "histogram", help);
+        uint64_t cumulative = 0, sum = 0;
+        char le[32];
+        for (size_t i = 0; i < Histogram::BUCKETS; i++)
+        {
+            for (size_t p = 0; p < count; p++) cumulative += parts[p]->bucket(i);
+            if (i + 1 < Histogram::BUCKETS)
+                snprintf(le, sizeof(le), "le=\"%g\"", (1ULL << i) / 1e6);
+            else
+                snprintf(le, sizeof(le), "le=\"+Inf\"");
+            sample((std::string(name) + "_bucket").c_str(), le, cumulative);
+        }
+        for (size_t p = 0; p < count; p++) sum += parts[p]->sum();
+        char line[96];
+        snprintf(line, sizeof(line), "%s_sum %.6f\n", name, sum / 1e6);
+        out += line;
+        sample((std::string(name) + "_count").c_str(), "", cumulative);
+    }
+
+    void histogram(const char* name, const char* help, const Histogram& h)
+    {
+        const Histogram* parts[1] = { &h };
+        histogram(name, help, parts, 1);
+    }
+
+    std::string out;
+};
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Warm-start snapshot of a router's routing state, in a flat binary file it
+// can memory-map on restart:
+//   header   magic "DVSNAP1\0", time written, own sequence number, router
+//            index of the owner, name, row, entry counts, names length
+//   names    per router: name offset, name length
+//   rows     per neighbor: router index, first entry, entry count
+//   entries  per row, the finite entries of the neighbor's last DV:
+//            destination index, cost, sequence number
+//   names    router ids, back to back
+// The routing table itself is not stored: it is recomputed from the rows,
+// which also restores the alternates and equal-cost next hops.
+#define SNAP_MAGIC "DVSNAP1"
+
+class RouteSnapshot {
+public:
+    struct Header {
+        char magic[8];
+        uint64_t saved_at; // Unix time
+        uint32_t seqno; // the owner's own sequence number (loop-free mode)
+        uint32_t self; // name index of the owner
+        uint32_t names;
+        uint32_t rows;
+        uint32_t entries;
+        uint32_t names_len;
+    };
+
+    struct Name {
+        uint32_t off;
+        uint32_t len;
+    };
+
+    struct Row {
+        uint32_t neighbor;
+        uint32_t entry_begin;
+        uint32_t entry_count;
+    };
+
+    struct Entry {
+        uint32_t dest;
+        int32_t cost;
+        uint32_t seqno;
+    };
+
+    // Collects a snapshot in memory; write() then replaces the file at once
+    class Builder {
+    public:
+        Builder() { memset(&header, 0, sizeof(header)); }
+
+        void set_owner(uint32_t self, uint32_t seqno)
+        {
+            header.self = self;
+            header.seqno = seqno;
+        }
+
+        // names are indexed in the order they are added
+        void add_name(const std::string& name)
+        {
+            Name n;
+            n.off = (uint32_t) names.size();
+            n.len = (uint32_t) name.size();
+            name_index.push_back(n);
+            names += name;
+        }
+
+        // the entries added next belong to this neighbor
+        void add_row(uint32_t neighbor)
+        {
+            Row r;
+            r.neighbor = neighbor;
+            r.entry_begin = (uint32_t) entries.size();
+            r.entry_count = 0;
+            rows.push_back(r);
+        }
+
+        void add_entry(uint32_t dest, int32_t cost, uint32_t seqno)
+        {
+            Entry e;
+            e.dest = dest;
+            e.cost = cost;
+            e.seqno = seqno;
+            entries.push_back(e);
+            rows.back().entry_count++;
+        }
+
+        // write to a temporary file and rename it over path, so a crash
+        // mid-write leaves the previous snapshot intact
+        bool write(const std::string& path)
+        {
+            memcpy(header.magic, SNAP_MAGIC, 8);
+            header.saved_at = (uint64_t) time(NULL);
+            header.names = (uint32_t) name_index.size();
+            header.rows = (uint32_t) rows.size();
+            header.entries = (uint32_t) entries.size();
+            header.names_len = (uint32_t) names.size();
+
+            std::string tmp = path + ".tmp";
+            FILE* file = fopen(tmp.c_str(), "wb");
+            if (!file) return false;
+            fwrite(&header, sizeof(header), 1, file);
+            fwrite(name_index.data(), sizeof(Name), name_index.size(), file);
+            fwrite(rows.data(), sizeof(Row), rows.size(), file);
+            fwrite(entries.data(), sizeof(Entry), entries.size(), file);
+            fwrite(names.data(), 1, names.size(), file);
+            bool ok = !ferror(file);
+            ok = fclose(file) == 0 && ok;
+            if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+            {
+                unlink(tmp.c_str());
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        Header header;
+        std::vector<Name> name_index;
+        std::vector<Row> rows;
+        std::vector<Entry> entries;
+        std::string names;
+    };
+
+    RouteSnapshot() : base(NULL), len(0) {}
+    ~RouteSnapshot() { close(); }
+
+    // map the file read-only; false if it is missing or malformed
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header))
+        {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        base = (const char*) p;
+        len = st.st_size;
+
+        header = (const Header*) base;
+        name_index = (const Name*) (header + 1);
+        rows = (const Row*) (name_index + header->names);
+        entries = (const Entry*) (rows + header->rows);
+        names = (const char*) (entries + header->entries);
+        size_t need = sizeof(Header) + (size_t) header->names * sizeof(Name) + (size_t) header->rows * sizeof(Row) +
+                      (size_t) header->entries * sizeof(Entry) + header->names_len;
+        if (memcmp(header->magic, SNAP_MAGIC, 8) != 0 || need != len || header->self >= header->names || !valid())
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (base) munmap((void*) base, len);
+        base = NULL;
+        len = 0;
+    }
+
+    uint64_t saved_at() const { return header->saved_at; }
+    uint32_t seqno() const { return header->seqno; }
+    uint32_t self() const { return header->self; }
+    size_t name_count() const { return header->names; }
+    std::string name(uint32_t idx) const { return std::string(names + name_index[idx].off, name_index[idx].len); }
+    size_t row_count() const { return header->rows; }
+    const Row& row(size_t i) const { return rows[i]; }
+    const Entry* entries_begin(size_t i) const { return entries + rows[i].entry_begin; }
+    const Entry* entries_end(size_t i) const { return entries_begin(i) + rows[i].entry_count; }
+
+private:
+    // every offset and index within bounds, so readers need no checks
+    bool valid() const
+    {
+        for (uint32_t i = 0; i < header->names; i++)
+        {
+            if ((uint64_t) name_index[i].off + name_index[i].len > header->names_len) return false;
+        }
+        for (uint32_t i = 0; i < header->rows; i++)
+        {
+            if (rows[i].neighbor >= header->names ||
+                (uint64_t) rows[i].entry_begin + rows[i].entry_count > header->entries) return false;
+        }
+        for (uint32_t i = 0; i < header->entries; i++)
+        {
+            if (entries[i].dest >= header->names) return false;
+        }
+        return true;
+    }
+
+    const char* base;
+    size_t len;
+    const Header* header;
+    const Name* name_index;
+    const Row* rows;
+    const Entry* entries;
+    const char* names;
+};
+
+#endif
@@ -0,0 +1,142 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <vector>
+
+// Hierarchical timing wheel over integer keys, in ticks of the caller's
+// choosing. Level 0 has one slot per tick; each level above has slots
+// 64 times as wide and is cascaded into the level below as the clock reaches
+// it. Scheduling and firing are O(1) per entry. Entries cannot be cancelled:
+// owners check on firing whether the entry is still wanted (see
+// LivenessWheel).
+class TimerWheel {
+    const static unsigned BITS = 6;
+    const static uint64_t SLOTS = 1 << BITS;
+    const static uint64_t MASK = SLOTS - 1;
+
+    struct Entry {
+        uint32_t key;
+        uint64_t deadline;
+    };
+
+public:
+    TimerWheel(unsigned levels = 4) : levels(levels), now_tick(0), slots(levels * SLOTS) {}
+
+    uint64_t now() const { return now_tick; }
+
+    // fire key once the clock reaches deadline (the next tick if that has passed)
+    void schedule(uint32_t key, uint64_t deadline)
+    {
+        Entry entry;
+        entry.key = key;
+        entry.deadline = deadline > now_tick ? deadline : now_tick + 1;
+        slots[slot_for(entry.deadline)].push_back(entry);
+    }
+
+    // move the clock forward to tick, calling fire(key) for every entry due
+    template <typename Fire>
+    void advance(uint64_t tick, Fire fire)
+    {
+        while (now_tick < tick)
+        {
+            now_tick++;
+            // pull down the higher-level slots that start at this tick, widest first
+            for (unsigned level = levels - 1; level > 0; level--)
+            {
+                if ((now_tick & ((1ULL << (BITS * level)) - 1)) != 0) continue;
+                due.swap(slots[level * SLOTS + ((now_tick >> (BITS * level)) & MASK)]);
+                for (auto& entry : due) slots[slot_for(entry.deadline)].push_back(entry);
+                due.clear();
+            }
+            due.swap(slots[now_tick & MASK]);
+            for (auto& entry : due)
+            {
+                if (entry.deadline <= now_tick)
+                    fire(entry.key);
+                else // parked beyond the wheel's span
+                    slots[slot_for(entry.deadline)].push_back(entry);
+            }
+            due.clear();
+        }
+    }
+
+private:
+    // the lowest level with deadline fewer than SLOTS of its slots ahead; a
+    // slot is cascaded when the clock enters it, so it is never a lap late
+    size_t slot_for(uint64_t deadline) const
+    {
+        for (unsigned level = 0; level < levels; level++)
+        {
+            unsigned shift = BITS * level;
+            if ((deadline >> shift) - (now_tick >> shift) < SLOTS)
+                return level * SLOTS + ((deadline >> shift) & MASK);
+        }
+        // past the top level's span: park in the slot the clock enters last
+        unsigned shift = BITS * (levels - 1);
+        return (levels - 1) * SLOTS + (((now_tick >> shift) + SLOTS - 1) & MASK);
+    }
+
+    unsigned levels;
+    uint64_t now_tick;
+    std::vector<std::vector<Entry> > slots; // level * SLOTS + slot => entries
+    std::vector<Entry> due; // slot being processed
+};
+
+// Per-key deadlines, e.g. one per neighbor, on a TimerWheel. Refreshing a key
+// only stores its new deadline; the wheel holds at most one entry per key and
+// re-files it when it comes due before the stored deadline. Keys whose
+// deadline passes are handed back together on each advance.
+class LivenessWheel {
+public:
+    uint64_t now() const { return wheel.now(); }
+
+    // the key expires ticks from now unless refreshed again
+    void refresh(uint32_t key, uint64_t ticks)
+    {
+        if (key >= deadline.size())
+        {
+            deadline.resize(key + 1, 0);
+            queued.resize(key + 1, false);
+        }
+        deadline[key] = wheel.now() + (ticks > 0 ? ticks : 1);
+        if (!queued[key])
+        {
+            queued[key] = true;
+            wheel.schedule(key, deadline[key]);
+        }
+    }
+
+    void cancel(uint32_t key)
+    {
+        if (key < deadline.size()) deadline[key] = 0;
+    }
+
+    // move the clock to tick and call expired(keys) with every key whose
+    // deadline passed, if any
+    template <typename Expired>
+    void advance(uint64_t tick, Expired expired)
+    {
+        dead.clear();
+        wheel.advance(tick, [this](uint32_t key) {
+            if (deadline[key] > wheel.now())
+            {
+                wheel.schedule(key, deadline[key]); // refreshed since it was filed
+                return;
+            }
+            queued[key] = false;
+            if (deadline[key] != 0) dead.push_back(key);
+            deadline[key] = 0;
+        });
+        if (!dead.empty()) expired(dead);
+    }
+
+private:
+    TimerWheel wheel;
+    std::vector<uint64_t> deadline; // key => tick it expires at, 0 if not armed
+    std::vector<bool> queued; // key => has an entry in the wheel
+    std::vector<uint32_t> dead; // keys expired by the current advance
+};
+
+#endif
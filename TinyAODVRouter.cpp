@@ -2,11 +2,16 @@
 #include <boost/array.hpp>
 #include <boost/bind.hpp>
 #include <boost/algorithm/string.hpp>
+#include <chrono>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <stdint.h>
 #include <deque>
+#include <unistd.h>
+
+#include "BatchUdp.h"
+#include "BufferPool.h"
 
 using namespace std;
 using namespace boost::asio::ip;
@@ -22,14 +27,44 @@ struct Interface {
 
 /* ----- TinyAOVDRouter ---------- */
 
+// Expanding-ring search (RFC 3561, section 6.4): the first RREQ for a
+// destination only reaches TTL_START hops; each timeout widens the ring by
+// TTL_INCREMENT up to TTL_THRESHOLD, then the whole network is searched
+// RREQ_RETRIES more times before the queued data is dropped.
+#define TTL_START 1
+#define TTL_INCREMENT 2
+#define TTL_THRESHOLD 7
+#define NET_DIAMETER 35
+#define RREQ_RETRIES 2
+#define NODE_TRAVERSAL_MS 40 // conservative one-hop delay, queuing included
+#define TIMEOUT_BUFFER 2
+#define PATH_DISCOVERY_MS (4 * NODE_TRAVERSAL_MS * NET_DIAMETER) // longest an RREQ can still be in flight
+#define RREQ_CACHE_SIZE 256 // RREQs remembered for duplicate suppression
+
+// time an RREQ with this TTL may take to reach the ring's edge and back
+inline int ring_traversal_ms(int ttl)
+{
+    return 2 * NODE_TRAVERSAL_MS * (ttl + TIMEOUT_BUFFER);
+}
+
+vector<string> split_fields(const string& str, size_t found)
+{
+    vector<string> fields;
+    string body = str.substr(found + 1);
+    boost::split(fields, body, boost::is_any_of(","));
+    return fields;
+}
+
+// "rreq:src,dest,hop count,rreq id,ttl". (src, rreq id) identifies a
+// discovery round: every router forwards it at most once
 struct RREQ {
-    RREQ(string src_id, string dest_id, int hop_count)
-    : src_id(src_id), dest_id(dest_id), hop_count(hop_count) {}
+    RREQ(string src_id, string dest_id, int hop_count, uint32_t rreq_id = 0, int ttl = 0)
+    : src_id(src_id), dest_id(dest_id), hop_count(hop_count), rreq_id(rreq_id), ttl(ttl) {}
     
     string toString()
     {
         return "rreq:" + src_id + "," + dest_id + "," +
-                to_string(hop_count);
+                to_string(hop_count) + "," + to_string(rreq_id) + "," + to_string(ttl);
     }
     
     static RREQ fromString(string rreq_str)
@@ -38,18 +73,10 @@ struct RREQ {
         if (found != std::string::npos &&
             rreq_str.substr(0, found).compare("rreq") == 0)
         {
-            size_t next_found = rreq_str.find(",", found + 1);
-            string src_id = rreq_str.substr(found + 1, next_found - found);
-            
-            found = next_found;
-            next_found = rreq_str.find(",", found + 1);
-            string dest_id = rreq_str.substr(found + 1, next_found - found);
-            
-            found = next_found;
-            next_found = rreq_str.find(",", found + 1);
-            int hop_count = stoi(rreq_str.substr(found + 1, next_found - found));
-            
-            return RREQ(src_id, dest_id, hop_count);
+            vector<string> fields = split_fields(rreq_str, found);
+            if (fields.size() != 5) return RREQ::emptyRREQ();
+            return RREQ(fields[0], fields[1], atoi(fields[2].c_str()),
+                        (uint32_t) strtoul(fields[3].c_str(), NULL, 10), atoi(fields[4].c_str()));
         }
         else
         {
@@ -72,15 +99,18 @@ struct RREQ {
     string src_id;
     string dest_id;
     int hop_count;
+    uint32_t rreq_id; // per-origin counter, new for every RREQ sent
+    int ttl; // hops the RREQ may still travel
 };
 
+// "rrep:src,dest,hop count", sent back along the reverse route
 struct RREP {
     RREP(string src_id, string dest_id, int hop_count)
     : src_id(src_id), dest_id(dest_id), hop_count(hop_count) {}
     
     string toString()
     {
-        return "rreq:" + src_id + "," + dest_id + "," +
+        return "rrep:" + src_id + "," + dest_id + "," +
                 to_string(hop_count);
     }
     
@@ -90,18 +120,9 @@ struct RREP {
         if (found != std::string::npos &&
             rrep_str.substr(0, found).compare("rrep") == 0)
         {
-            size_t next_found = rrep_str.find(",", found + 1);
-            string src_id = rrep_str.substr(found + 1, next_found - found);
-            
-            found = next_found;
-            next_found = rrep_str.find(",", found + 1);
-            string dest_id = rrep_str.substr(found + 1, next_found - found);
-            
-            found = next_found;
-            next_found = rrep_str.find(",", found + 1);
-            int hop_count = stoi(rrep_str.substr(found + 1, next_found - found));
-            
-            return RREP(src_id, dest_id, hop_count);
+            vector<string> fields = split_fields(rrep_str, found);
+            if (fields.size() != 3) return RREP::emptyRREP();
+            return RREP(fields[0], fields[1], atoi(fields[2].c_str()));
         }
         else
         {
@@ -126,6 +147,65 @@ struct RREP {
     int hop_count;
 };
 
+// RREQs seen in the last PATH_DISCOVERY_MS, for duplicate suppression. A ring
+// of (key, time seen) in arrival order: a lookup scans back from the newest
+// and stops at the first expired entry, so it costs the RREQs in flight, and
+// the memory is fixed whatever the traffic. A full ring overwrites its
+// oldest entry, which can only let a stale duplicate through.
+class RreqCache {
+public:
+    RreqCache() : head(0), count(0) {}
+    
+    // true if (src, rreq_id) was seen recently; otherwise remember it
+    bool seen(const string& src_id, uint32_t rreq_id, std::chrono::steady_clock::time_point now)
+    {
+        uint64_t k = key(src_id, rreq_id);
+        std::chrono::steady_clock::time_point horizon = now - std::chrono::milliseconds(PATH_DISCOVERY_MS);
+        for (size_t i = 0; i < count; i++)
+        {
+            const Entry& e = ring[(head + RREQ_CACHE_SIZE - 1 - i) % RREQ_CACHE_SIZE];
+            if (e.at < horizon)
+            {
+                count = i; // everything older has expired too
+                break;
+            }
+            if (e.key == k) return true;
+        }
+        ring[head].key = k;
+        ring[head].at = now;
+        head = (head + 1) % RREQ_CACHE_SIZE;
+        count = min(count + 1, (size_t) RREQ_CACHE_SIZE);
+        return false;
+    }
+    
+private:
+    struct Entry {
+        uint64_t key;
+        std::chrono::steady_clock::time_point at;
+    };
+    
+    // FNV-1a of the origin and its id
+    static uint64_t key(const string& src_id, uint32_t rreq_id)
+    {
+        uint64_t h = 14695981039346656037ULL;
+        for (char c : src_id)
+        {
+            h ^= (uint8_t) c;
+            h *= 1099511628211ULL;
+        }
+        for (int i = 0; i < 4; i++)
+        {
+            h ^= (rreq_id >> (8 * i)) & 0xFF;
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+    
+    Entry ring[RREQ_CACHE_SIZE];
+    size_t head; // next slot written
+    size_t count; // entries that may still be live, newest first back from head
+};
+
 struct RERR {
     // TODO: ...
 };
@@ -157,11 +237,20 @@ struct FREntry {
 class TinyAODVRouter
 {
     const static int MAX_LENGTH = 1024;
+    
+    // a route discovery waiting for its RREP
+    struct Discovery {
+        Discovery(boost::asio::io_service& io_service) : ttl(TTL_START), retries(0), timer(io_service) {}
+        
+        int ttl; // TTL of the last RREQ sent
+        int retries; // network-wide searches so far
+        boost::asio::deadline_timer timer; // runs out if no RREP comes back in time
+    };
 public:
     TinyAODVRouter(boost::asio::io_service& io_service, string id,
-             uint16_t local_port, map<string, Interface> neighbors)
-    : sock(io_service, udp::endpoint(udp::v4(), local_port)), io_service(io_service),
-    id(id), local_port(local_port), neighbors(neighbors)
+             uint16_t local_port, map<string, Interface> neighbors, size_t batch = 0)
+    : sock(io_service, udp::endpoint(udp::v4(), local_port)), send_pool(MAX_LENGTH), io_service(io_service),
+    id(id), local_port(local_port), neighbors(neighbors), rreq_id(0), stdinput(io_service, STDIN_FILENO)
     {
         // initialize its own distance vector and routing table (only know neighbors' info)
         for (auto& i : neighbors)
@@ -172,7 +261,22 @@ public:
         }
         
         // receive from neighbors
-        start_receive();
+        if (batch > 0)
+        {
+            batch_io.reset(new BatchUdp(sock, batch, MAX_LENGTH));
+            batch_io->start([this](const char* data, size_t len, const udp::endpoint& from)
+                            {
+                                remote_endpoint = from;
+                                handle_message(string(data, len));
+                            });
+        }
+        else
+        {
+            start_receive();
+        }
+        
+        // input from stdin
+        start_input();
     }
     
     // send data message from upper layer
@@ -180,7 +284,7 @@ public:
     {
         if (FRTable.count(dest_id) > 0) // found
         {
-            send("data:" + message, udp::endpoint(udp::v4(), FRTable[id].next_hop));
+            send("data:" + dest_id + ":" + message, udp::endpoint(udp::v4(), FRTable[dest_id].next_hop));
         }
         else // not found -> route discovery
         {
@@ -194,20 +298,54 @@ public:
     
 private:
     
+    // one discovery per destination at a time; data queued meanwhile waits for it
     void route_discovery(string dest_id)
     {
-        // construct RREQ
-        RREQ rreq(id, dest_id, 0);
+        if (discoveries.count(dest_id) > 0) return;
+        discoveries[dest_id].reset(new Discovery(io_service));
+        send_rreq(dest_id);
+    }
+    
+    void send_rreq(string dest_id)
+    {
+        Discovery& discovery = *discoveries[dest_id];
+        
+        // construct RREQ; every attempt gets a new id so routers forward it again
+        RREQ rreq(id, dest_id, 0, ++rreq_id, discovery.ttl);
+        rreq_cache.seen(id, rreq.rreq_id, std::chrono::steady_clock::now()); // our own RREQ coming back is a duplicate
         
         // broadcast RREQ
         broadcast(rreq.toString());
+        
+        discovery.timer.expires_from_now(boost::posix_time::milliseconds(ring_traversal_ms(discovery.ttl)));
+        discovery.timer.async_wait(boost::bind(&TinyAODVRouter::discovery_timeout, this, dest_id,
+                                               boost::asio::placeholders::error));
+    }
+    
+    // no RREP in time: search a wider ring, then the whole network, then give up
+    void discovery_timeout(string dest_id, const boost::system::error_code& error)
+    {
+        if (error == boost::asio::error::operation_aborted || discoveries.count(dest_id) == 0) return;
+        Discovery& discovery = *discoveries[dest_id];
+        if (discovery.ttl >= NET_DIAMETER && ++discovery.retries > RREQ_RETRIES)
+        {
+            cout << id << " No route to " << dest_id << ", dropping " << data_queue[dest_id].size()
+            << " queued messages" << endl << endl;
+            data_queue.erase(dest_id);
+            discoveries.erase(dest_id);
+            return;
+        }
+        discovery.ttl += TTL_INCREMENT;
+        if (discovery.ttl > TTL_THRESHOLD) discovery.ttl = NET_DIAMETER;
+        send_rreq(dest_id);
     }
     
-    void broadcast(string message)
+    void broadcast(string message, uint16_t except = 0)
     {
         for (auto& i : neighbors)
         {
             Interface interface = i.second;
+            if (interface.port == except) continue;
             cout << id << " Broadcast to " << i.first << ": " << message << endl;
             udp::endpoint sendee_endpoint(udp::v4(), interface.port);
             send(message, sendee_endpoint);
@@ -215,12 +353,19 @@ private:
         cout << endl;
     }
     
-    void send(string message, udp::endpoint sendee_endpoint)
+    void send(const string& message, udp::endpoint sendee_endpoint)
     {
-        sock.async_send_to(boost::asio::buffer(message), sendee_endpoint,
+        if (batch_io)
+        {
+            batch_io->send(message.data(), message.size(), sendee_endpoint);
+            return;
+        }
+        // the completion handler holds the slab until the send is done
+        SendBuffer buffer = send_pool.copy(message.data(), message.size());
+        sock.async_send_to(boost::asio::buffer(buffer.data(), buffer.size()), sendee_endpoint,
                            boost::bind(&TinyAODVRouter::handle_send, this,
                                        boost::asio::placeholders::error,
-                                       boost::asio::placeholders::bytes_transferred));
+                                       boost::asio::placeholders::bytes_transferred, buffer));
     }
     
     void start_receive()
@@ -235,102 +380,138 @@ private:
     {
         if (!error || error == boost::asio::error::message_size)
         {
-            string recv_str(recv_buffer.begin(), recv_buffer.begin() + bytes_recvd);
+            handle_message(string(recv_buffer.begin(), recv_buffer.begin() + bytes_recvd));
             
-            cout << id << " Received from " << remote_endpoint.port() << ": " << recv_str << endl;
-            cout << endl;
+            // continue listening
+            start_receive();
+        }
+    }
+    
+    // "data:B:hello" sends hello to B, discovering a route first if needed
+    void start_input()
+    {
+        boost::asio::async_read_until(stdinput, input_buffer, "\n",
+                                      boost::bind(&TinyAODVRouter::handle_input, this,
+                                                  boost::asio::placeholders::error));
+    }
+    
+    void handle_input(const boost::system::error_code& error)
+    {
+        if (error) return;
+        string line;
+        istream input(&input_buffer);
+        getline(input, line);
+        boost::algorithm::trim_if(line, boost::is_any_of("\r\n "));
+        vector<string> tokens;
+        boost::split(tokens, line, boost::is_any_of(":"));
+        if (tokens.size() >= 3 && tokens[0].compare("data") == 0)
+            send_data(line.substr(tokens[0].size() + tokens[1].size() + 2), tokens[1]);
+        start_input();
+    }
+    
+    // handle one datagram from remote_endpoint
+    void handle_message(const string& recv_str)
+    {
+        cout << id << " Received from " << remote_endpoint.port() << ": " << recv_str << endl;
+        cout << endl;
+        
+        RREQ rreq = RREQ::fromString(recv_str);
+        RREP rrep = RREP::fromString(recv_str);
+//        RERR rerr = RERR::fromString(recv_str); // TODO
+        
+        if (!rreq.isEmpty()) // is RREQ controll msg
+        {
+            // each router handles a discovery round once, however many
+            // neighbors pass it on: floods cost O(edges) messages
+            if (rreq_cache.seen(rreq.src_id, rreq.rreq_id, std::chrono::steady_clock::now()))
+                return;
             
-            RREQ rreq = RREQ::fromString(recv_str);
-            RREP rrep = RREP::fromString(recv_str);
-//            RERR rerr = RERR::fromString(recv_str); // TODO
+            // increment hop_count
+            rreq.hop_count++;
             
-            if (!rreq.isEmpty()) // is RREQ controll msg
+            // add / update reverse route table
+            if (RRTable.count(rreq.src_id) == 0 ||
+                RRTable[rreq.src_id].hop_count >= rreq.hop_count)
             {
-                // increment hop_count
-                rreq.hop_count++;
-                
-                if (id.compare(rreq.dest_id) == 0) // I am the destination
-                {
-                    // contrust RREP and send (unicast) back to src
-                    RREP new_rrep(rreq.src_id, rreq.dest_id, 0);
-                    uint16_t port = RRTable[rreq.src_id].next_hop;
-                    send(new_rrep.toString(), udp::endpoint(udp::v4(), port));
-                }
-                else
-                {
-                    // add / update reverse route table
-                    if (RRTable.count(rreq.src_id) == 0 ||
-                        RRTable[rreq.src_id].hop_count > rreq.hop_count)
-                    {
-                        RRTable[rreq.src_id] = RREntry(remote_endpoint.port() /* next_hop */,
-                                                  rreq.hop_count);
-                    }
-                    else // broadcast
-                    {
-                        broadcast(rreq.toString());
-                    }
-                }
+                RRTable[rreq.src_id] = RREntry(remote_endpoint.port() /* next_hop */,
+                                          rreq.hop_count);
             }
-            else if (!rrep.isEmpty()) // is RREP controll msg
+            
+            if (id.compare(rreq.dest_id) == 0) // I am the destination
             {
-                // increment hop_count
-                rrep.hop_count++;
-                
-                if (id.compare(rrep.src_id) == 0) // I am the src
-                {
-                    // complete. able to send data msgs
-                    send_queued_data(rrep.dest_id);
-                }
-                else
-                {
-                    // add / update forward route table
-                    if (FRTable.count(rrep.dest_id) == 0 ||
-                        FRTable[rrep.dest_id].hop_count > rrep.hop_count)
-                    {
-                        FRTable[rrep.dest_id] = FREntry(remote_endpoint.port() /* next_hop */,
-                                                  rreq.hop_count);
-                    }
-                    else // unicast back using RRTable
-                    {
-                        uint16_t port = RRTable[rrep.src_id].next_hop;
-                        send(rrep.toString(), udp::endpoint(udp::v4(), port));
-                    }
-                }
+                // contrust RREP and send (unicast) back to src
+                RREP new_rrep(rreq.src_id, rreq.dest_id, 0);
+                uint16_t port = RRTable[rreq.src_id].next_hop;
+                send(new_rrep.toString(), udp::endpoint(udp::v4(), port));
             }
-//            else if (!rerr.isEmpty()) // is RERR controll msg
-//            {
-//                // TODO
-//            }
-            else // is data message
+            else if (--rreq.ttl > 0) // broadcast, except back where it came from
             {
-                
+                broadcast(rreq.toString(), remote_endpoint.port());
             }
+        }
+        else if (!rrep.isEmpty()) // is RREP controll msg
+        {
+            // increment hop_count
+            rrep.hop_count++;
             
-            // continue listening
-            start_receive();
+            // add / update forward route table
+            if (FRTable.count(rrep.dest_id) == 0 ||
+                FRTable[rrep.dest_id].hop_count > rrep.hop_count)
+            {
+                FRTable[rrep.dest_id] = FREntry(remote_endpoint.port() /* next_hop */,
+                                          rrep.hop_count);
+            }
+            
+            if (id.compare(rrep.src_id) == 0) // I am the src
+            {
+                // complete. able to send data msgs
+                discoveries.erase(rrep.dest_id); // cancels its timer
+                send_queued_data(rrep.dest_id);
+            }
+            else if (RRTable.count(rrep.src_id) > 0) // unicast back using RRTable
+            {
+                uint16_t port = RRTable[rrep.src_id].next_hop;
+                send(rrep.toString(), udp::endpoint(udp::v4(), port));
+            }
+        }
+//        else if (!rerr.isEmpty()) // is RERR controll msg
+//        {
+//            // TODO
+//        }
+        else // is data message: "data:dest:message"
+        {
+            vector<string> tokens;
+            boost::split(tokens, recv_str, boost::is_any_of(":"));
+            if (tokens.size() < 3 || tokens[0].compare("data") != 0) return;
+            string message = recv_str.substr(tokens[0].size() + tokens[1].size() + 2);
+            if (id.compare(tokens[1]) == 0)
+                cout << id << " Received data: " << message << endl << endl;
+            else if (FRTable.count(tokens[1]) > 0)
+                send(recv_str, udp::endpoint(udp::v4(), FRTable[tokens[1]].next_hop));
         }
     }
     
     void send_queued_data(string dest_id)
     {
-        // send all data in data_queue with dest_id
-        deque<string> queue_of_data = data_queue[dest_id];
+        // send all data in data_queue with dest_id, and delete it
+        deque<string> queue_of_data;
+        queue_of_data.swap(data_queue[dest_id]);
+        data_queue.erase(dest_id);
         for (auto& data : queue_of_data)
         {
             send_data(data, dest_id);
         }
-        
-        // deletes all data
-        queue_of_data.clear();
     }
     
     void handle_send(const boost::system::error_code& error,
-                     std::size_t bytes_transferred)
+                     std::size_t bytes_transferred, SendBuffer buffer)
     {
-        
+        buffer.release(); // back to the pool
     }
     
     udp::socket sock;
+    unique_ptr<BatchUdp> batch_io; // set in batched I/O mode
+    BufferPool send_pool; // slabs for outgoing datagrams
     boost::asio::io_service& io_service;
     string id;
     uint16_t local_port;
@@ -340,15 +521,21 @@ private:
     map<string, RREntry> RRTable; // (Reverse Route Table) src_id => RREntry
     map<string, FREntry> FRTable; // (Forward Route Table) dest_id => FREntry
     map<string, deque<string> > data_queue; // dest_id => queue of msgs
+    uint32_t rreq_id; // id of the last RREQ we originated
+    RreqCache rreq_cache; // RREQs already handled
+    map<string, unique_ptr<Discovery> > discoveries; // dest_id => discovery in progress
+    boost::asio::posix::stream_descriptor stdinput;
+    boost::asio::streambuf input_buffer;
 };
 
 int main(int argc, char** argv)
 {
-    if (argc != 2)
+    if (argc != 2 && !(argc == 4 && string(argv[2]).compare("--batch") == 0))
     {
-        cout << "Wrong arguments. Correct: ./my-router <id>" << endl;
+        cout << "Wrong arguments. Correct: ./my-router <id> [--batch N]" << endl;
         return 0;
     }
+    size_t batch = argc == 4 ? atoi(argv[3]) : 0;
     
     string id = string(argv[1]);
     uint16_t local_port = 0;
@@ -382,7 +569,7 @@ int main(int argc, char** argv)
     }
     
     boost::asio::io_service io_service;
-    TinyAODVRouter rt(io_service, id, local_port, neighbors);
+    TinyAODVRouter rt(io_service, id, local_port, neighbors, batch);
     io_service.run();
     
     return 0;
@@ -0,0 +1,424 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Network topologies: the init.txt text format, seeded synthetic graphs and
+// an indexed binary format a router can memory-map.
+struct Topology {
+    // one directed link, i.e. one init.txt line "src,dest,dest port,cost"
+    struct Link {
+        Link(uint32_t src, uint32_t dest, int cost) : src(src), dest(dest), cost(cost) {}
+
+        uint32_t src, dest; // router indices
+        int cost;
+    };
+
+    std::vector<std::string> names; // router index => id
+    std::vector<uint16_t> ports; // router index => listening port, 0 if unknown
+    std::vector<Link> links;
+    std::map<std::string, uint32_t> index_of; // id => router index
+
+    size_t size() const { return names.size(); }
+
+    uint32_t router(const std::string& id)
+    {
+        auto it = index_of.find(id);
+        if (it != index_of.end()) return it->second;
+        uint32_t index = (uint32_t) names.size();
+        names.push_back(id);
+        ports.push_back(0);
+        index_of[id] = index;
+        return index;
+    }
+
+    // read an init.txt-style file; error describes the first problem
+    bool read_text(const std::string& path, std::string& error)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+        {
+            error = "Cannot open topology " + path;
+            return false;
+        }
+        std::string line;
+        while (getline(file, line))
+        {
+            size_t c1 = line.find(','), c2 = line.find(',', c1 + 1), c3 = line.find(',', c2 + 1);
+            if (c1 == std::string::npos || c2 == std::string::npos || c3 == std::string::npos)
+            {
+                if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+                error = "Bad topology line: " + line;
+                return false;
+            }
+            uint32_t src = router(trim(line.substr(0, c1)));
+            uint32_t dest = router(trim(line.substr(c1 + 1, c2 - c1 - 1)));
+            if (ports[dest] == 0) ports[dest] = (uint16_t) atoi(line.c_str() + c2 + 1);
+            links.push_back(Link(src, dest, atoi(line.c_str() + c3 + 1)));
+        }
+        for (size_t i = 0; i < size(); i++)
+        {
+            if (ports[i] == 0)
+            {
+                error = "No port number for router " + names[i];
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool write_text(const std::string& path) const
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) return false;
+        write_text(file);
+        return fclose(file) == 0;
+    }
+
+    void write_text(FILE* file) const
+    {
+        for (auto& link : links)
+            fprintf(file, "%s,%s,%u,%d\n", names[link.src].c_str(), names[link.dest].c_str(),
+                    (unsigned) ports[link.dest], link.cost);
+    }
+
+    // write the indexed binary format read by TopologyIndex
+    bool write_index(const std::string& path) const;
+
+private:
+    static std::string trim(const std::string& s)
+    {
+        size_t b = s.find_first_not_of(" \t\r");
+        if (b == std::string::npos) return "";
+        return s.substr(b, s.find_last_not_of(" \t\r") - b + 1);
+    }
+};
+
+// Seeded synthetic topologies for the simulator and benchmarks. A spec names
+// the shape and its size:
+//   line:N         N routers in a chain
+//   ring:N         N routers in a cycle
+//   grid:WxH       W by H mesh
+//   scalefree:N[:M]  Barabasi-Albert graph, each new router linking to M
+//                    (default 2) existing ones chosen by degree
+// Routers are named R0 .. R<N-1> and router i listens on base_port + i.
+// Every link is bidirectional with the same cost, uniform in [1, max_cost].
+class TopologyGenerator {
+public:
+    TopologyGenerator(uint64_t seed, int max_cost = 10, uint16_t base_port = 10000)
+    : rng(seed), max_cost(std::max(1, max_cost)), base_port(base_port) {}
+
+    // false if spec is not a known shape or does not fit in the port space
+    bool generate(const std::string& spec, Topology& topo)
+    {
+        std::vector<std::string> parts = split(spec);
+        if (parts.size() < 2) return false;
+        const std::string& shape = parts[0];
+        topo = Topology();
+
+        if (shape == "line" || shape == "ring")
+        {
+            size_t n = atoi(parts[1].c_str());
+            if (n < 2 || !add_routers(n, topo)) return false;
+            for (uint32_t i = 0; i + 1 < n; i++) link(topo, i, i + 1);
+            if (shape == "ring" && n > 2) link(topo, (uint32_t) n - 1, 0);
+            return true;
+        }
+        if (shape == "grid")
+        {
+            size_t x = parts[1].find('x');
+            if (x == std::string::npos) return false;
+            size_t w = atoi(parts[1].substr(0, x).c_str());
+            size_t h = atoi(parts[1].substr(x + 1).c_str());
+            if (w == 0 || h == 0 || w * h < 2 || !add_routers(w * h, topo)) return false;
+            for (uint32_t r = 0; r < h; r++)
+            {
+                for (uint32_t c = 0; c < w; c++)
+                {
+                    uint32_t i = r * w + c;
+                    if (c + 1 < w) link(topo, i, i + 1);
+                    if (r + 1 < h) link(topo, i, i + (uint32_t) w);
+                }
+            }
+            return true;
+        }
+        if (shape == "scalefree")
+        {
+            size_t n = atoi(parts[1].c_str());
+            size_t m = parts.size() > 2 ? atoi(parts[2].c_str()) : 2;
+            if (m == 0 || n <= m || !add_routers(n, topo)) return false;
+            scale_free(n, m, topo);
+            return true;
+        }
+        return false;
+    }
+
+private:
+    static std::vector<std::string> split(const std::string& spec)
+    {
+        std::vector<std::string> parts;
+        size_t pos = 0;
+        while (true)
+        {
+            size_t colon = spec.find(':', pos);
+            parts.push_back(spec.substr(pos, colon - pos));
+            if (colon == std::string::npos) break;
+            pos = colon + 1;
+        }
+        return parts;
+    }
+
+    bool add_routers(size_t n, Topology& topo)
+    {
+        if (base_port + n > 65536) return false;
+        for (size_t i = 0; i < n; i++)
+        {
+            uint32_t index = topo.router("R" + std::to_string(i));
+            topo.ports[index] = (uint16_t) (base_port + i);
+        }
+        return true;
+    }
+
+    // a bidirectional link: one Link each way with the same cost
+    void link(Topology& topo, uint32_t a, uint32_t b)
+    {
+        int cost = std::uniform_int_distribution<int>(1, max_cost)(rng);
+        topo.links.push_back(Topology::Link(a, b, cost));
+        topo.links.push_back(Topology::Link(b, a, cost));
+    }
+
+    // preferential attachment: a router is picked with probability proportional
+    // to its degree by sampling a uniform endpoint of the links made so far
+    void scale_free(size_t n, size_t m, Topology& topo)
+    {
+        std::vector<uint32_t> endpoints;
+        for (uint32_t i = 0; i <= m; i++) // start from a clique of m + 1 routers
+        {
+            for (uint32_t j = i + 1; j <= m; j++)
+            {
+                link(topo, i, j);
+                endpoints.push_back(i);
+                endpoints.push_back(j);
+            }
+        }
+        std::set<uint32_t> targets;
+        for (uint32_t i = (uint32_t) m + 1; i < n; i++)
+        {
+            targets.clear();
+            while (targets.size() < m)
+                targets.insert(endpoints[std::uniform_int_distribution<size_t>(0, endpoints.size() - 1)(rng)]);
+            for (uint32_t t : targets)
+            {
+                link(topo, i, t);
+                endpoints.push_back(i);
+                endpoints.push_back(t);
+            }
+        }
+    }
+
+    std::mt19937_64 rng;
+    int max_cost;
+    uint16_t base_port;
+};
+
+// Indexed topology file, in host byte order:
+//   header   magic "DVTOPO1\0", router count, link count, hash slot count, names length
+//   slots    open-addressed FNV-1a hash of router ids => router index (0xFFFFFFFF: empty)
+//   routers  per router: name offset, first link, link count, name length, port
+//   links    per link, grouped by source router: destination index, cost
+//   names    router ids, back to back
+// A router maps the file, hashes its id to its own record and reads its links
+// and its neighbors' ports from there, so it touches O(degree) of the file.
+#define TOPO_MAGIC "DVTOPO1"
+#define TOPO_NO_ROUTER 0xFFFFFFFF
+
+class TopologyIndex {
+public:
+    struct Header {
+        char magic[8];
+        uint32_t routers;
+        uint32_t links;
+        uint32_t slots;
+        uint32_t names_len;
+    };
+
+    struct Router {
+        uint32_t name_off;
+        uint32_t link_begin;
+        uint32_t link_count;
+        uint16_t name_len;
+        uint16_t port;
+    };
+
+    struct Link {
+        uint32_t dest;
+        int32_t cost;
+    };
+
+    TopologyIndex() : base(NULL), len(0) {}
+    ~TopologyIndex() { close(); }
+
+    static bool is_index(const std::string& path)
+    {
+        char magic[8];
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) return false;
+        bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, TOPO_MAGIC, 8) == 0;
+        fclose(file);
+        return ok;
+    }
+
+    // map the file read-only; false if it cannot be read or is malformed
+    bool open(const std::string& path)
+    {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header))
+        {
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) return false;
+        base = (const char*) p;
+        len = st.st_size;
+
+        header = (const Header*) base;
+        slots = (const uint32_t*) (header + 1);
+        routers = (const Router*) (slots + header->slots);
+        links = (const Link*) (routers + header->routers);
+        names = (const char*) (links + header->links);
+        size_t need = sizeof(Header) + (size_t) header->slots * sizeof(uint32_t) +
+                      (size_t) header->routers * sizeof(Router) + (size_t) header->links * sizeof(Link) +
+                      header->names_len;
+        if (memcmp(header->magic, TOPO_MAGIC, 8) != 0 || need != len || header->slots == 0 ||
+            (header->slots & (header->slots - 1)) != 0)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (base) munmap((void*) base, len);
+        base = NULL;
+        len = 0;
+    }
+
+    // router index of id, TOPO_NO_ROUTER if absent
+    uint32_t find(const std::string& id) const
+    {
+        uint32_t mask = header->slots - 1;
+        for (uint32_t i = topo_hash(id.data(), id.size()) & mask; ; i = (i + 1) & mask)
+        {
+            uint32_t idx = slots[i];
+            if (idx == TOPO_NO_ROUTER || idx >= header->routers) return TOPO_NO_ROUTER;
+            if (routers[idx].name_len == id.size() && memcmp(name_ptr(idx), id.data(), id.size()) == 0) return idx;
+        }
+    }
+
+    size_t size() const { return header->routers; }
+    size_t link_count() const { return header->links; }
+    std::string name(uint32_t idx) const { return std::string(name_ptr(idx), routers[idx].name_len); }
+    uint16_t port(uint32_t idx) const { return routers[idx].port; }
+    const Link* links_begin(uint32_t idx) const { return links + routers[idx].link_begin; }
+    const Link* links_end(uint32_t idx) const { return links_begin(idx) + routers[idx].link_count; }
+
+    static uint32_t topo_hash(const char* s, size_t n)
+    {
+        // FNV-1a
+        uint32_t h = 2166136261u;
+        for (size_t i = 0; i < n; i++)
+        {
+            h ^= (uint8_t) s[i];
+            h *= 16777619u;
+        }
+        return h;
+    }
+
+private:
+    const char* name_ptr(uint32_t idx) const { return names + routers[idx].name_off; }
+
+    const char* base;
+    size_t len;
+    const Header* header;
+    const uint32_t* slots;
+    const Router* routers;
+    const Link* links;
+    const char* names;
+};
+
+inline bool Topology::write_index(const std::string& path) const
+{
+    TopologyIndex::Header header;
+    memcpy(header.magic, TOPO_MAGIC, 8);
+    header.routers = (uint32_t) size();
+    header.links = (uint32_t) links.size();
+    header.slots = 16;
+    while (header.slots < 2 * size()) header.slots *= 2;
+
+    // links grouped by source, in file order within a source
+    std::vector<uint32_t> begin(size() + 1, 0);
+    for (auto& link : links) begin[link.src + 1]++;
+    for (size_t i = 0; i < size(); i++) begin[i + 1] += begin[i];
+    std::vector<TopologyIndex::Link> out_links(links.size());
+    std::vector<uint32_t> fill(begin.begin(), begin.end() - 1);
+    for (auto& link : links)
+    {
+        TopologyIndex::Link& l = out_links[fill[link.src]++];
+        l.dest = link.dest;
+        l.cost = link.cost;
+    }
+
+    std::vector<TopologyIndex::Router> out_routers(size());
+    std::string out_names;
+    std::vector<uint32_t> slots(header.slots, TOPO_NO_ROUTER);
+    for (uint32_t i = 0; i < size(); i++)
+    {
+        if (names[i].size() > 0xFFFF) return false;
+        TopologyIndex::Router& r = out_routers[i];
+        r.name_off = (uint32_t) out_names.size();
+        r.name_len = (uint16_t) names[i].size();
+        r.link_begin = begin[i];
+        r.link_count = begin[i + 1] - begin[i];
+        r.port = ports[i];
+        out_names += names[i];
+
+        uint32_t mask = header.slots - 1;
+        uint32_t s = TopologyIndex::topo_hash(names[i].data(), names[i].size()) & mask;
+        while (slots[s] != TOPO_NO_ROUTER) s = (s + 1) & mask;
+        slots[s] = i;
+    }
+    header.names_len = (uint32_t) out_names.size();
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    fwrite(&header, sizeof(header), 1, file);
+    fwrite(slots.data(), sizeof(uint32_t), slots.size(), file);
+    fwrite(out_routers.data(), sizeof(TopologyIndex::Router), out_routers.size(), file);
+    fwrite(out_links.data(), sizeof(TopologyIndex::Link), out_links.size(), file);
+    fwrite(out_names.data(), 1, out_names.size(), file);
+    return fclose(file) == 0;
+}
+
+#endif
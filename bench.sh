@@ -0,0 +1,50 @@
+#!/bin/sh
+# Convergence benchmarks: runs each scenario through DVSim and prints one JSON
+# object per run (see DVSim --json). BENCH_ARGS is passed to every run, e.g.
+# BENCH_ARGS=--delta; BENCH_LARGE=1 adds the 1k-10k router topologies.
+# Exits non-zero if any run ends with a wrong route.
+
+SIM=${SIM:-./DVSim}
+status=0
+
+run()
+{
+    name=$1; topology=$2; duration=$3; shift 3
+    events=""
+    for e in "$@"; do
+        case "$e" in
+            --*) events="$events $e" ;; # extra DVSim options, e.g. "--hello-ms 100"
+            *) events="$events --event $e" ;;
+        esac
+    done
+    out=$($SIM --json --name "$name" --topology "$topology" --duration "$duration" --verify 50 $events $BENCH_ARGS) || status=1
+    echo "$out"
+    case "$out" in *'"routes_wrong":0}'*) ;; *) status=1 ;; esac
+}
+
+# the bundled 6-router network
+run init6-cost init.txt 40 15:cost:A:E:20
+run init6-fail init.txt 60 15:fail:F
+run init6-fail-hello init.txt 60 "--hello-ms 100" 15:fail:F
+# a failed end of a chain: the rest count to infinity
+run line20-count-to-infinity line:20 60 15:fail:R19
+run ring100-cost ring:100 40 15:cost:R10:R11:50
+run ring100-fail ring:100 60 15:fail:R50
+# a failed router in a mesh: without --loop-free its routes count to infinity
+# around the remaining loops
+run grid10x10-fail grid:10x10 60 15:fail:R44
+run grid10x10-fail-loopfree grid:10x10 60 --loop-free 15:fail:R44
+run grid10x10-cost-linkdown grid:10x10 40 15:cost:R44:R45:50 25:linkdown:R44:R54
+# links added and removed live at both ends, no restart
+run grid10x10-reconfigure grid:10x10 60 15:addlink:R0:R99:1 30:removelink:R44:R45 45:removelink:R0:R99
+run scalefree200-cost-linkdown scalefree:200 40 15:cost:R0:R1:50 25:linkdown:R0:R2
+run scalefree200-fail-hub scalefree:200 60 15:fail:R0
+run scalefree200-fail-hub-loopfree scalefree:200 60 --loop-free 15:fail:R0
+
+if [ -n "$BENCH_LARGE" ]; then
+    run grid30x30-cost grid:30x30 20 10:cost:R435:R436:50
+    run scalefree1000-cost scalefree:1000 20 10:cost:R0:R1:50
+    run scalefree10000-cost scalefree:10000 20 10:cost:R0:R1:50
+fi
+
+exit $status